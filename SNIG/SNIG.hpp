@@ -2,8 +2,14 @@
 
 //others are not included
 
+#include "utility/config.hpp"
+
+#ifdef SNIG_ENABLE_CUDA
 #include "snig/snig.hpp"
 #include "gpipe/gpipe.hpp"
 #include "bf/bf.hpp"
+#endif
+
+#include "cpu/cpu.hpp"
 
 
@@ -1,7 +1,20 @@
 #pragma once
 
+#include <SNIG/utility/config.hpp>
 #include <SNIG/utility/utility.hpp>
+#include <SNIG/utility/reader.hpp>
+#include <SNIG/utility/mapped_weight.hpp>
+#include <SNIG/utility/compressed_weight.hpp>
+#include <SNIG/utility/model_format.hpp>
+#ifdef SNIG_ENABLE_CUDA
+#include <SNIG/utility/cuda_error.hpp>
+#endif
 #include <chrono>
+#include <cstdlib>
+#include <new>
+#include <memory>
+#include <vector>
+#include <algorithm>
 
 namespace snig {
 
@@ -24,14 +37,28 @@ class Base {
     size_t _sec_size;
 
     //weights
-    int* _host_pinned_weight;
+    //page-locked with CUDA, plain host memory in host-only builds
+    int* _host_pinned_weight{nullptr};
+    //zero-copy views of the weight files, replaces _host_pinned_weight if enabled
+    std::unique_ptr<MappedWeight<T> > _mapped_weight;
+    //compressed weight decoded into a ring of layers, replaces both if enabled
+    //a layer must be acquired before its views are read
+    std::unique_ptr<CompressedWeight<T> > _compressed_weight;
     size_t _max_nnz;
+    //values take _max_vals slots per layer, 1 if every layer is uniform
+    size_t _max_vals;
+    //uniform layers store a single value at the beginning of their val_w
+    std::vector<bool> _uniform_layers;
+    //row indices are uint16_t relative to their section instead of global int
+    //always set for sections of at most MAX_SHORT_SEC_SIZE neurons, except for mapped int files
+    bool _short_index {false};
     size_t _pad {0};
     size_t _p_w_index_len;
     size_t _pp_w_index_len;
     size_t _pp_wlen;
     size_t _pp_wsize;
 
+#ifdef SNIG_ENABLE_CUDA
     //kernel configuration
     dim3 _threads{32, 32, 1};
 
@@ -42,9 +69,47 @@ class Base {
       const size_t num_neurons,
       const size_t num_layers
     );
+#endif
+
+    Base(
+      const std::fs::path& weight_path,
+      const T bias,
+      const size_t num_neurons,
+      const size_t num_layers,
+      const bool map_weight = false,
+      const bool compress_weight = false
+    );
 
     virtual ~Base();
 
+    //per-layer views of the packed CSC weight, independent of the storage
+    //_row_w is null if _short_index is set, _short_row_w otherwise
+    const int* _col_w(const size_t layer) const;
+
+    const int* _row_w(const size_t layer) const;
+
+    const uint16_t* _short_row_w(const size_t layer) const;
+
+    const T* _val_w(const size_t layer) const;
+
+    bool _uniform_w(const size_t layer) const;
+
+    //read ahead upcoming layers of the mapped or compressed weight
+    void _prefetch_weight(const size_t layer);
+
+    //read ahead only the columns of layer in the sorted neuron ranges of columns
+    //no-op unless the weight is mapped
+    void _prefetch_weight_columns(
+      const size_t layer,
+      const std::vector<std::pair<size_t, size_t> >& columns
+    );
+
+    //pins a layer of the compressed weight while its views are used
+    //no-op for other storages
+    void _acquire_weight(const size_t layer);
+
+    void _release_weight(const size_t layer);
+
   
     //  API: cout("my ", string, " is ", a, b, '\n');
     //       -> cout << "my" << string << " is " << a << b << '\n';
@@ -67,6 +132,20 @@ class Base {
 
     void _load_weight(const std::fs::path& weight_path); 
 
+    void _load_model(const std::fs::path& model_path);
+
+    void _map_weight(const std::fs::path& weight_path);
+
+    void _compress_weight(const std::fs::path& weight_path);
+
+    void _set_sec(const size_t sec_size, const size_t num_secs);
+
+    void _set_num_vals(const std::vector<size_t>& nnz, const std::vector<size_t>& num_vals);
+
+    void _set_weight_len();
+
+    void _alloc_weight();
+
     template <typename L>
     void _cout(L&& last) const;
 
@@ -94,6 +173,7 @@ class Base {
 // Definition of Base
 // ----------------------------------------------------------------------------
 
+#ifdef SNIG_ENABLE_CUDA
 template <typename T>
 Base<T>::Base(
   const dim3& threads,
@@ -101,20 +181,57 @@ Base<T>::Base(
   const T bias,
   const size_t num_neurons,
   const size_t num_layers
+) : 
+  Base<T>(weight_path, bias, num_neurons, num_layers)
+{
+  _threads = threads;
+
+  //GPU kernels only read uint16_t row indices
+  if(!_short_index) {
+    throw std::runtime_error("section size exceeds the range of 16-bit row indices");
+  }
+}
+#endif
+
+template <typename T>
+Base<T>::Base(
+  const std::fs::path& weight_path,
+  const T bias,
+  const size_t num_neurons,
+  const size_t num_layers,
+  const bool map_weight,
+  const bool compress_weight
 ) : 
   _bias{bias},
   _num_neurons{num_neurons},
-  _num_layers{num_layers},
-  _threads{threads}
+  _num_layers{num_layers}
 {
   _sec_size = get_sec_size<T>(Base<T>::_num_neurons);
   _num_secs = (Base<T>::_num_neurons) / _sec_size;
-  _load_weight(weight_path);
+
+  //a single-file model container takes precedence over layer files
+  std::fs::path model_path = find_model_file(weight_path, _num_neurons);
+  if(compress_weight) {
+    _compress_weight(weight_path);
+  }
+  else if(map_weight) {
+    _map_weight(weight_path);
+  }
+  else if(!model_path.empty()) {
+    _load_model(model_path);
+  }
+  else {
+    _load_weight(weight_path);
+  }
 }
 
 template <typename T>
 Base<T>::~Base() {
+#ifdef SNIG_ENABLE_CUDA
   checkCuda(cudaFreeHost(_host_pinned_weight));
+#else
+  std::free(_host_pinned_weight);
+#endif
 }
 
 template <typename T>
@@ -129,9 +246,203 @@ void Base<T>::_load_weight(const std::fs::path& weight_path) {
                _num_neurons
              );
 
+  std::vector<size_t> nnz;
+  std::vector<size_t> num_vals;
+  find_layer_sizes_binary<T>(
+    weight_path,
+    _num_layers,
+    _num_neurons,
+    _num_secs,
+    nnz,
+    num_vals
+  );
+  _set_num_vals(nnz, num_vals);
+
+  //layer files store int row indices, they are converted while reading
+  _short_index = fits_short_row_index(_sec_size);
+  _set_weight_len();
+
+  _alloc_weight();
+
+  read_weight_binary<T>(
+    weight_path,
+    _num_neurons,
+    _max_nnz,
+    _max_vals,
+    _num_layers,
+    _num_secs,
+    _pad,
+    _short_index,
+    _host_pinned_weight
+  );
+
+  toc();
+  log("Finish reading DNN layers with ", duration(), " ms", "\n");
+}
+
+template <typename T>
+void Base<T>::_load_model(const std::fs::path& model_path) {
+  using namespace std::literals::string_literals;
+
+  log("Loading the model......");
+
+  tic();
+
+  //one open and one forward pass over the container
+  std::ifstream in(model_path, std::ios::in | std::ios::binary);
+  if(!in) {
+    throw std::runtime_error("cannot open the file"s + model_path.c_str());
+  }
+
+  std::vector<ModelLayerIndex> index;
+  ModelHeader header = read_model_header(in, index);
+  check_model_header<T>(header, _num_neurons, _num_layers, model_path);
+  _set_sec(header.sec_size, header.num_secs);
+
+  _max_nnz = 0;
+  std::vector<size_t> nnz(_num_layers);
+  std::vector<size_t> num_vals(_num_layers);
+  for(size_t i = 0; i < _num_layers; ++i) {
+    _max_nnz = std::max<size_t>(_max_nnz, index[i].nnz);
+    nnz[i] = index[i].nnz;
+    num_vals[i] = index[i].num_vals;
+  }
+  _set_num_vals(nnz, num_vals);
+
+  _short_index = fits_short_row_index(_sec_size);
+  _set_weight_len();
+
+  _alloc_weight();
+
+  read_model_binary<T>(
+    in,
+    header,
+    index,
+    _num_neurons,
+    _max_nnz,
+    _max_vals,
+    _num_layers,
+    _num_secs,
+    _pad,
+    _short_index,
+    _host_pinned_weight
+  );
+
+  toc();
+  log("Finish reading DNN layers with ", duration(), " ms", "\n");
+}
+
+template <typename T>
+void Base<T>::_map_weight(const std::fs::path& weight_path) {
+  log("Mapping the weight......");
+
+  tic();
+
+  _mapped_weight = std::make_unique<MappedWeight<T> >(
+    weight_path,
+    _num_neurons,
+    _num_layers,
+    _num_secs
+  );
+
+  _set_sec(_mapped_weight->sec_size(), _mapped_weight->num_secs());
+  _max_nnz = _mapped_weight->max_nnz();
+  _max_vals = _mapped_weight->max_vals();
+  _uniform_layers.resize(_num_layers);
+  for(size_t i = 0; i < _num_layers; ++i) {
+    _uniform_layers[i] = _mapped_weight->uniform(i);
+  }
+  _short_index = _mapped_weight->short_index();
+  _set_weight_len();
+
+  toc();
+  log("Finish mapping DNN layers with ", duration(), " ms", "\n");
+}
+
+template <typename T>
+void Base<T>::_compress_weight(const std::fs::path& weight_path) {
+  log("Compressing the weight......");
+
+  tic();
+
+  _compressed_weight = std::make_unique<CompressedWeight<T> >(
+    weight_path,
+    _num_neurons,
+    _num_layers,
+    _num_secs
+  );
+
+  _set_sec(_compressed_weight->sec_size(), _compressed_weight->num_secs());
+  _max_nnz = _compressed_weight->max_nnz();
+  _max_vals = _compressed_weight->max_vals();
+  _uniform_layers.resize(_num_layers);
+  for(size_t i = 0; i < _num_layers; ++i) {
+    _uniform_layers[i] = _compressed_weight->uniform(i);
+  }
+  _short_index = true;
+  _set_weight_len();
+
+  toc();
+  log("Finish compressing DNN layers with ", duration(), " ms", "\n");
+  log(
+    "Compressed weight : ", _compressed_weight->compressed_size() >> 20, " MB (",
+    _compressed_weight->decoded_size() >> 20, " MB decoded)", "\n"
+  );
+}
+
+template <typename T>
+void Base<T>::_set_sec(const size_t sec_size, const size_t num_secs) {
+#ifdef SNIG_ENABLE_CUDA
+  //a section must fit into the shared memory of the device
+  if(sec_size > _sec_size) {
+    throw std::runtime_error("section size of the model exceeds the shared memory, please reconvert the model");
+  }
+#endif
+  _sec_size = sec_size;
+  _num_secs = num_secs;
+}
+
+template <typename T>
+void Base<T>::_set_num_vals(const std::vector<size_t>& nnz, const std::vector<size_t>& num_vals) {
+  _max_vals = 0;
+  _uniform_layers.resize(_num_layers);
+  for(size_t i = 0; i < _num_layers; ++i) {
+    _max_vals = std::max(_max_vals, num_vals[i]);
+    _uniform_layers[i] = num_vals[i] < nnz[i];
+  }
+
+  size_t num_uniform = std::count(_uniform_layers.begin(), _uniform_layers.end(), true);
+  if(num_uniform > 0) {
+    log(num_uniform, " uniform layers......");
+  }
+}
+
+template <typename T>
+void Base<T>::_alloc_weight() {
+#ifdef SNIG_ENABLE_CUDA
+  checkCuda(cudaMallocHost(
+    (void**)&_host_pinned_weight,
+    _pp_wsize * _num_layers
+  ));
+#else
+  _host_pinned_weight = static_cast<int*>(std::malloc(_pp_wsize * _num_layers));
+  if(_host_pinned_weight == nullptr) {
+    throw std::bad_alloc();
+  }
+#endif
+
+  std::memset(
+    _host_pinned_weight,
+    0,
+    _pp_wsize * _num_layers
+  );
+}
+
+template <typename T>
+void Base<T>::_set_weight_len() {
   // total length of row and col index
   // value index should consider sizeof(T)
-  _p_w_index_len  = _num_neurons * _num_secs + _max_nnz + 1;
+  _p_w_index_len  = _num_neurons * _num_secs + row_index_len(_max_nnz, _short_index) + 1;
 
   //handle aligned
   if((sizeof(int) * _p_w_index_len) % sizeof(T) != 0) {
@@ -143,34 +454,101 @@ void Base<T>::_load_weight(const std::fs::path& weight_path) {
 
   //pad packed weight length
   //max_nnz should be even, otherwis it needs to be padded
-  _pp_wlen = _pp_w_index_len + (sizeof(T) / sizeof(int)) * _max_nnz;
+  //uniform layers only need one value, so the value part shrinks to _max_vals
+  //values narrower than int are rounded up to whole int slots
+  _pp_wlen = _pp_w_index_len + packed_val_len<T>(_max_vals);
 
   //pad packed weight size
-  _pp_wsize = sizeof(int) * (_pp_w_index_len) + sizeof(T) * _max_nnz;
-  
-  checkCuda(cudaMallocHost(
-    (void**)&_host_pinned_weight,
-    _pp_wsize * _num_layers
-  ));
+  _pp_wsize = sizeof(int) * _pp_wlen;
+}
 
-  std::memset(
-    _host_pinned_weight,
-    0,
-    _pp_wsize * _num_layers
-  );
+template <typename T>
+const int* Base<T>::_col_w(const size_t layer) const {
+  if(_compressed_weight) {
+    return _compressed_weight->col_w(layer);
+  }
+  if(_mapped_weight) {
+    return _mapped_weight->col_w(layer);
+  }
+  return _host_pinned_weight + layer * _pp_wlen;
+}
 
-  read_weight_binary<T>(
-    weight_path,
-    _num_neurons,
-    _max_nnz,
-    _num_layers,
-    _num_secs,
-    _pad,
-    _host_pinned_weight
-  );
+template <typename T>
+const int* Base<T>::_row_w(const size_t layer) const {
+  if(_compressed_weight) {
+    return nullptr;
+  }
+  if(_mapped_weight) {
+    return _mapped_weight->row_w(layer);
+  }
+  if(_short_index) {
+    return nullptr;
+  }
+  return _host_pinned_weight + layer * _pp_wlen + _num_neurons * _num_secs + 1;
+}
 
-  toc();
-  log("Finish reading DNN layers with ", duration(), " ms", "\n");
+template <typename T>
+const uint16_t* Base<T>::_short_row_w(const size_t layer) const {
+  if(_compressed_weight) {
+    return _compressed_weight->short_row_w(layer);
+  }
+  if(_mapped_weight) {
+    return _mapped_weight->short_row_w(layer);
+  }
+  if(!_short_index) {
+    return nullptr;
+  }
+  return (const uint16_t*)(_host_pinned_weight + layer * _pp_wlen + _num_neurons * _num_secs + 1);
+}
+
+template <typename T>
+const T* Base<T>::_val_w(const size_t layer) const {
+  if(_compressed_weight) {
+    return _compressed_weight->val_w(layer);
+  }
+  if(_mapped_weight) {
+    return _mapped_weight->val_w(layer);
+  }
+  return (const T*)(_host_pinned_weight + layer * _pp_wlen + _p_w_index_len);
+}
+
+template <typename T>
+bool Base<T>::_uniform_w(const size_t layer) const {
+  return _uniform_layers[layer];
+}
+
+template <typename T>
+void Base<T>::_prefetch_weight(const size_t layer) {
+  if(_compressed_weight) {
+    _compressed_weight->prefetch(layer);
+  }
+  if(_mapped_weight) {
+    _mapped_weight->prefetch(layer);
+  }
+}
+
+template <typename T>
+void Base<T>::_prefetch_weight_columns(
+  const size_t layer,
+  const std::vector<std::pair<size_t, size_t> >& columns
+) {
+  if(_mapped_weight) {
+    _mapped_weight->prefetch_columns(layer, columns);
+  }
+}
+
+template <typename T>
+void Base<T>::_acquire_weight(const size_t layer) {
+  if(_compressed_weight) {
+    _compressed_weight->acquire(layer);
+  }
+}
+
+template <typename T>
+void Base<T>::_release_weight(const size_t layer) {
+  if(_compressed_weight) {
+    _compressed_weight->release(layer);
+  }
 }
 
 template <typename T>
@@ -216,7 +216,7 @@ void BF<T>::_infer() {
       }
 
       int* roffw = _dev_W[dev][cur_layer % 2];
-      int* colsw = _dev_W[dev][cur_layer % 2] + Base<T>::_num_neurons * Base<T>::_num_secs + 1;
+      uint16_t* colsw = (uint16_t*)(_dev_W[dev][cur_layer % 2] + Base<T>::_num_neurons * Base<T>::_num_secs + 1);
       T* valsw = (T*)(_dev_W[dev][cur_layer % 2] + Base<T>::_p_w_index_len);
 
       bf_inference<T><<<_dev_nerowsY[dev], Base<T>::_threads, sizeof(T) * Base<T>::_sec_size, dev_stream[dev][1]>>>(
@@ -230,6 +230,7 @@ void BF<T>::_infer() {
         roffw,
         colsw,
         valsw,
+        Base<T>::_uniform_w(cur_layer),
         Base<T>::_bias,
         _dev_Y[dev][(cur_layer + 1) % 2],
         _dev_rlenY[dev][(cur_layer + 1) % 2]
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 
 namespace snig{
 
@@ -13,8 +14,9 @@ void bf_inference(
   const size_t N_SLAB,
   const size_t num_neurons_per_layer,
   const int* roffW,
-  const int* colsW,
+  const uint16_t* colsW,
   const T* valsW,
+  const bool uniformW,
   const T bias,
   T* Y1,
   int* rlenY1
@@ -35,8 +37,9 @@ void bf_inference(
   const size_t N_SLAB,
   const size_t num_neurons_per_layer,
   const int* roffW,
-  const int* colsW,
+  const uint16_t* colsW,
   const T* valsW,
+  const bool uniformW,
   const T bias,
   T* Y1,
   int* rlenY1
@@ -69,10 +72,12 @@ void bf_inference(
       }
       int begOffW = roffW[i * num_neurons_per_layer + j] + threadIdx.x;
       int endOffW = roffW[i * num_neurons_per_layer + j + 1];
+      //column indices are relative to slab i
       for(int k = begOffW; k < endOffW; k += blockDim.x) {
         int colW = colsW[k];
-        T valW = valsW[k];
-        atomicAdd(&shRow[colW - i * COL_BLK], valY * valW);
+        //a uniform layer stores a single value
+        T valW = uniformW ? valsW[0] : valsW[k];
+        atomicAdd(&shRow[colW], valY * valW);
       }
     }
     __syncthreads();
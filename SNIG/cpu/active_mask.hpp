@@ -0,0 +1,225 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace snig{
+
+//Block-level activity mask of a row of Y
+//A row is split into blocks of ACTIVE_BLOCK neurons, bit b of the mask is set
+//if any neuron of block b may be nonzero, a cleared bit guarantees zeros.
+//Together with the section flags of is_nonzero_row it forms a two-level bitmap:
+//kernels skip zero sections by their flags and zero blocks of a nonzero section
+//by iterating the set bits of the mask, so deep layers with a few scattered
+//nonzeros do not test every activation.
+//Kernels write the mask of their output row while applying bias and ReLU.
+//Blocks are aligned to neuron 0, a block may span two sections
+//if sec_size is not a multiple of ACTIVE_BLOCK.
+
+constexpr size_t ACTIVE_BLOCK = 64;
+
+inline
+size_t active_mask_blocks(const size_t num_neurons);
+
+inline
+size_t active_mask_words(const size_t num_neurons);
+
+inline
+void clear_active_mask(uint64_t* mask, const size_t num_neurons);
+
+inline
+bool is_empty_active_mask(const uint64_t* mask, const size_t num_neurons);
+
+inline
+void mark_active_block(uint64_t* mask, const size_t neuron);
+
+inline
+size_t active_block_end(const size_t s_o, const size_t i, const size_t sec_size);
+
+template <typename T>
+void build_active_mask(
+  const T* Y,
+  const bool* is_nonzero_row,
+  const size_t sec_size,
+  const size_t num_secs,
+  uint64_t* mask
+);
+
+inline
+void union_active_mask(const uint64_t* mask, const size_t num_neurons, uint64_t* result);
+
+inline
+size_t count_active_blocks(const uint64_t* mask, const size_t num_neurons);
+
+inline
+void active_ranges(
+  const uint64_t* mask,
+  const size_t num_neurons,
+  std::vector<std::pair<size_t, size_t> >& ranges
+);
+
+//iterates the set blocks of a mask overlapping the neurons [beg, end) with tzcnt
+//each block is clipped to [beg, end)
+class ActiveBlocks {
+
+  public:
+
+    ActiveBlocks(const uint64_t* mask, const size_t beg, const size_t end);
+
+    //returns false after the last set block
+    bool next(size_t& block_beg, size_t& block_end);
+
+  private:
+
+    const uint64_t* _mask;
+    size_t _beg;
+    size_t _end;
+    size_t _word;
+    size_t _end_word;
+    uint64_t _bits;
+
+    uint64_t _load(const size_t word) const;
+};
+
+//-----------------------------------------------------------------------------
+//Definition of active mask function
+//-----------------------------------------------------------------------------
+
+inline
+size_t active_mask_blocks(const size_t num_neurons) {
+  return (num_neurons + ACTIVE_BLOCK - 1) / ACTIVE_BLOCK;
+}
+
+inline
+size_t active_mask_words(const size_t num_neurons) {
+  return (active_mask_blocks(num_neurons) + 63) / 64;
+}
+
+inline
+void clear_active_mask(uint64_t* mask, const size_t num_neurons) {
+  std::fill(mask, mask + active_mask_words(num_neurons), uint64_t(0));
+}
+
+//an empty mask replaces the scan of all section flags of a row
+inline
+bool is_empty_active_mask(const uint64_t* mask, const size_t num_neurons) {
+  return std::all_of(mask, mask + active_mask_words(num_neurons), [](uint64_t w){ return w == 0; });
+}
+
+inline
+void mark_active_block(uint64_t* mask, const size_t neuron) {
+  size_t block = neuron / ACTIVE_BLOCK;
+  mask[block / 64] |= uint64_t(1) << (block % 64);
+}
+
+//end of the block holding output i of section s_o, relative to the section
+//epilogues of the kernels flag one block at a time
+inline
+size_t active_block_end(const size_t s_o, const size_t i, const size_t sec_size) {
+  size_t neuron = s_o * sec_size + i;
+  return std::min((neuron / ACTIVE_BLOCK + 1) * ACTIVE_BLOCK - s_o * sec_size, sec_size);
+}
+
+//scans the nonzero sections of a row, used when rows enter the engine
+template <typename T>
+void build_active_mask(
+  const T* Y,
+  const bool* is_nonzero_row,
+  const size_t sec_size,
+  const size_t num_secs,
+  uint64_t* mask
+) {
+  clear_active_mask(mask, sec_size * num_secs);
+  for(size_t s = 0; s < num_secs; ++s) {
+    if(!is_nonzero_row[s]) {
+      continue;
+    }
+    for(size_t j = s * sec_size; j < (s + 1) * sec_size; ++j) {
+      if(Y[j] != 0) {
+        mark_active_block(mask, j);
+        //skip the rest of the block
+        j = std::min((j / ACTIVE_BLOCK + 1) * ACTIVE_BLOCK, (s + 1) * sec_size) - 1;
+      }
+    }
+  }
+}
+
+//ORs mask into result, the union of the rows of a batch gives the columns the batch reads
+inline
+void union_active_mask(const uint64_t* mask, const size_t num_neurons, uint64_t* result) {
+  for(size_t w = 0; w < active_mask_words(num_neurons); ++w) {
+    result[w] |= mask[w];
+  }
+}
+
+inline
+size_t count_active_blocks(const uint64_t* mask, const size_t num_neurons) {
+  size_t num_blocks = 0;
+  for(size_t w = 0; w < active_mask_words(num_neurons); ++w) {
+    num_blocks += __builtin_popcountll(mask[w]);
+  }
+  return num_blocks;
+}
+
+//neuron ranges [beg, end) of the set blocks of mask, adjacent blocks are merged
+inline
+void active_ranges(
+  const uint64_t* mask,
+  const size_t num_neurons,
+  std::vector<std::pair<size_t, size_t> >& ranges
+) {
+  ranges.clear();
+  ActiveBlocks blocks(mask, 0, num_neurons);
+  for(size_t beg, end; blocks.next(beg, end); ) {
+    if(!ranges.empty() && ranges.back().second == beg) {
+      ranges.back().second = end;
+    }
+    else {
+      ranges.emplace_back(beg, end);
+    }
+  }
+}
+
+inline
+ActiveBlocks::ActiveBlocks(const uint64_t* mask, const size_t beg, const size_t end) :
+  _mask{mask},
+  _beg{beg},
+  _end{end},
+  _word{beg / ACTIVE_BLOCK / 64},
+  _end_word{((end + ACTIVE_BLOCK - 1) / ACTIVE_BLOCK + 63) / 64},
+  _bits{beg < end ? _load(_word) : 0}
+{
+}
+
+//word of the mask with the blocks outside [beg, end) cleared
+inline
+uint64_t ActiveBlocks::_load(const size_t word) const {
+  const size_t beg_block = _beg / ACTIVE_BLOCK;
+  const size_t end_block = (_end + ACTIVE_BLOCK - 1) / ACTIVE_BLOCK;
+  uint64_t bits = _mask[word];
+  if(word == beg_block / 64) {
+    bits &= ~uint64_t(0) << (beg_block % 64);
+  }
+  if(word == (end_block - 1) / 64 && end_block % 64 != 0) {
+    bits &= ~(~uint64_t(0) << (end_block % 64));
+  }
+  return bits;
+}
+
+inline
+bool ActiveBlocks::next(size_t& block_beg, size_t& block_end) {
+  while(_bits == 0) {
+    if(++_word >= _end_word) {
+      return false;
+    }
+    _bits = _load(_word);
+  }
+  size_t block = _word * 64 + __builtin_ctzll(_bits);
+  _bits &= _bits - 1;
+  block_beg = std::max(block * ACTIVE_BLOCK, _beg);
+  block_end = std::min((block + 1) * ACTIVE_BLOCK, _end);
+  return true;
+}
+
+}// end of namespace snig ----------------------------------------------
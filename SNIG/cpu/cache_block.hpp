@@ -0,0 +1,108 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <unistd.h>
+
+namespace snig{
+
+//Layer-wise cache blocking of the CPU engine
+//Without blocking, every layer sweeps all rows of a batch, so the whole
+//batch_size x num_neurons activation matrix streams through memory per layer.
+//With blocking, a chunk of rows runs through a group of consecutive layers
+//while both of its activation buffers stay in L2,
+//and the next chunk reuses the weights of the group from L2 and L3.
+//Chunks take half of L2, the weights of a group the rest of L2
+//and the share of L3 of one thread.
+//Models whose layers exceed the caches use the opposite, weight-stationary order:
+//a block of output sections of a layer runs on all rows in flight before the next block,
+//so the weight of the block is read from memory once instead of once per row.
+
+struct CacheSizes {
+  size_t l2;
+  size_t l3;
+};
+
+struct CacheBlock {
+  //rows per chunk
+  size_t chunk_rows;
+  //consecutive layers run on a chunk before the next chunk
+  size_t layer_depth;
+};
+
+inline
+CacheSizes detect_cache_sizes();
+
+inline
+CacheBlock choose_cache_block(
+  const CacheSizes& cache,
+  const size_t num_neurons,
+  const size_t value_size,
+  const size_t layer_size,
+  const size_t num_threads
+);
+
+inline
+size_t choose_stationary_secs(
+  const CacheSizes& cache,
+  const size_t layer_size,
+  const size_t num_secs
+);
+
+//-----------------------------------------------------------------------------
+//Definition of cache block function
+//-----------------------------------------------------------------------------
+
+//sizes unknown to sysconf fall back to 1 MB of L2 and no L3
+inline
+CacheSizes detect_cache_sizes() {
+  CacheSizes cache{1 << 20, 0};
+#if defined(_SC_LEVEL2_CACHE_SIZE) && defined(_SC_LEVEL3_CACHE_SIZE)
+  long l2 = ::sysconf(_SC_LEVEL2_CACHE_SIZE);
+  long l3 = ::sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if(l2 > 0) {
+    cache.l2 = l2;
+  }
+  if(l3 > 0) {
+    cache.l3 = l3;
+  }
+#endif
+  return cache;
+}
+
+//layer_size is the number of bytes of the largest layer
+//a single layer per group means the weight does not fit, and rows are not split
+inline
+CacheBlock choose_cache_block(
+  const CacheSizes& cache,
+  const size_t num_neurons,
+  const size_t value_size,
+  const size_t layer_size,
+  const size_t num_threads
+) {
+  //a row holds both buffers of the rolling activations
+  const size_t row_size = 2 * num_neurons * value_size;
+  const size_t chunk_budget = cache.l2 / 2;
+  const size_t weight_budget = cache.l2 - chunk_budget + cache.l3 / std::max(num_threads, size_t{1});
+
+  CacheBlock block;
+  block.chunk_rows = std::max(chunk_budget / std::max(row_size, size_t{1}), size_t{1});
+  block.layer_depth = std::max(weight_budget / std::max(layer_size, size_t{1}), size_t{1});
+  if(block.layer_depth == 1) {
+    block.chunk_rows = ~size_t(0);
+  }
+  return block;
+}
+
+//number of output sections whose weight takes at most half of L2,
+//the rest of L2 holds the activations and accumulators of the current row
+inline
+size_t choose_stationary_secs(
+  const CacheSizes& cache,
+  const size_t layer_size,
+  const size_t num_secs
+) {
+  const size_t sec_weight_size = std::max(layer_size / std::max(num_secs, size_t{1}), size_t{1});
+  return std::min(std::max(cache.l2 / 2 / sec_weight_size, size_t{1}), num_secs);
+}
+
+}// end of namespace snig ----------------------------------------------
@@ -0,0 +1,1433 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <taskflow/taskflow.hpp>
+#include <SNIG/utility/reader.hpp>
+#include <SNIG/utility/input_stream.hpp>
+#include <SNIG/utility/matrix_format.h>
+#include <SNIG/utility/scoring.hpp>
+#include <SNIG/cpu/kernel.hpp>
+#include <SNIG/cpu/simd_kernel.hpp>
+#include <SNIG/cpu/pull_layout.hpp>
+#include <SNIG/cpu/cache_block.hpp>
+#include <SNIG/base/base.hpp>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <exception>
+#include <omp.h>
+
+namespace std {
+  namespace fs = experimental::filesystem;
+}
+
+namespace snig{
+
+template <typename T>
+class CPU : public Base<T> {
+
+  //CPU engine runs the same section-partitioned algorithm as snig_inference
+  //Each worker thread repeatedly fetches a batch of inputs
+  //and feeds it through all layers directly from the packed or mapped weight,
+  //or from its pull layout for layers where gathering is faster
+  //Rows whose activations all become zero are retired, so the work of a layer
+  //scales with the number of live rows instead of the batch size
+  //Within a live row, blocks of 64 zero activations are skipped by a block mask
+  //and the union of the masks of a batch limits the weight columns read from storage
+  //With re-batching, layers are split into segments of rebatch_interval layers
+  //and the survivors of a segment are merged into full batches for the next one
+  //With cache blocking, chunks of rows run through groups of layers (cache_block.hpp)
+  //With weight-stationary batches, each worker runs several input batches in lockstep
+  //and every block of output sections of a layer runs on all of their rows at once
+  //With a task graph, each chunk of layers of a batch is a task of a taskflow graph,
+  //and twice as many batches as threads move through different layers at once
+  //With interleaving, live rows are packed into tiles of TILE_WIDTH inputs at fetch
+  //and unpacked at the end of a segment, so the kernels run across inputs
+  //With a compressed weight, each worker pins the decoded layer it is running
+  //and only the push layout is used
+  //CPU<int16_t> runs on Q8.7 fixed point activations and weights (fixed_point.hpp),
+  //which halves the activation memory, weights must be quantized by the converter
+  //CPU<half> stores activations and weights in 16 bits and accumulates in float
+
+  static_assert(
+    std::is_same<T, float>::value || std::is_same<T, double>::value ||
+    std::is_same<T, int16_t>::value || std::is_same<T, half>::value,
+    "data type must be either float, double, int16_t, or half"
+  );
+
+  private:
+
+    //arithmetic of T, int16_t is Q5.10 and Q8.7 fixed point with int32_t accumulators, half accumulates in float
+    using Acc = typename ValueTraits<T>::acc_type;
+    using Real = typename ValueTraits<T>::real_type;
+
+    //bias in the unit of the accumulators
+    Acc _acc_bias;
+
+    size_t _batch_size;
+    size_t _num_threads;
+    size_t _rebatch_interval;
+    bool _interleave;
+    bool _cache_block;
+    CacheBlock _block;
+    //input batches each worker runs in lockstep, 0 keeps one batch per worker
+    size_t _stationary_batches;
+    //output sections of a weight block, all sections if not weight-stationary
+    size_t _stationary_secs;
+    //layers per task of the task graph, 0 runs the worker threads instead
+    size_t _task_chunk;
+    //batches in flight, each owns the buffers indexed by worker below
+    //one per thread for worker threads, twice the threads for the task graph
+    size_t _num_lanes;
+
+    //widest kernel supported by the CPU
+    CPUKernel _kernel;
+
+    WeightLayout _layout;
+
+    //pull layout of a layer, transposed from the packed weight the first time
+    //the layer runs as pull and released once AUTO mode settles it on push,
+    //workers hold a reference while they run the layer
+    struct PullSlot {
+      std::once_flag built;
+      std::shared_ptr<const PullLayer<T> > layer;
+    };
+    std::unique_ptr<PullSlot[]> _pull_layers;
+
+    //time of both layouts on the first batches of each layer in AUTO mode
+    //layout becomes PUSH or PULL once both are measured on enough batches
+    struct LayerProfile {
+      std::atomic<uint64_t> ns[2];
+      std::atomic<uint64_t> rows[2];
+      std::atomic<int> batches[2];
+      std::atomic<int> layout;
+    };
+    std::unique_ptr<LayerProfile[]> _profiles;
+
+    //ring of batch buffers filled by _input_stream
+    std::vector<T*> _source_Y;
+    std::vector<bool*> _source_is_nonzero_row;
+    std::unique_ptr<InputStream<T> > _input_stream;
+
+    //each worker owns the second buffer of its rolling Y and is_nonzero_row
+    //the first buffer points to the fetched batch of the ring
+    std::vector<std::vector<T*> > _Y;
+    std::vector<std::vector<bool*> > _is_nonzero_row;
+
+    //block masks of both buffers of _Y of each worker (active_mask.hpp)
+    //masks of a fetched batch are built at the start of each segment
+    //and then written by the kernels of every layer
+    std::vector<std::vector<uint64_t*> > _active_mask;
+    size_t _mask_words;
+
+    //union of the block masks of the live rows of each worker
+    //only the columns of its set blocks are read by the next layer of the batch,
+    //their neuron ranges are advised to a mapped weight
+    std::vector<std::vector<uint64_t> > _batch_mask;
+    std::vector<std::vector<std::pair<size_t, size_t> > > _batch_columns;
+    //blocks set in the unions and blocks of the layers they cover
+    std::atomic<size_t> _num_union_blocks{0};
+    std::atomic<size_t> _num_layer_blocks{0};
+
+    //each worker owns an accumulator of sec_size, replacing the shared memory
+    std::vector<Acc*> _sec_results;
+
+    //rows of the chunk each worker runs through a group of layers
+    std::vector<std::vector<size_t> > _chunk_rows;
+
+    //rows of the current batch of each worker that are still nonzero
+    //a row with all activations zero stays zero for every later layer,
+    //so it is retired with category 0 and never visited again
+    std::vector<std::vector<size_t> > _active_rows;
+    std::atomic<size_t> _num_retired_rows{0};
+
+    //tiles of each worker in the interleaved layout
+    //each worker owns both buffers of its rolling tiles and their section flags
+    std::vector<std::vector<T*> > _tile_Y;
+    std::vector<std::vector<bool*> > _tile_is_nonzero_sec;
+    std::vector<std::vector<size_t> > _active_tiles;
+
+    //input index of each row of the current input batch of each worker
+    std::vector<std::vector<size_t> > _batch_inputs;
+
+    //batch of survivors merged from several batches
+    //inputs holds the input index of each row
+    struct RowBatch {
+      T* Y;
+      bool* is_nonzero_row;
+      std::vector<size_t> inputs;
+    };
+
+    struct SegmentTask {
+      size_t segment;
+      RowBatch* batch;
+    };
+
+    //first layer of each segment, followed by the number of layers
+    std::vector<size_t> _segments;
+
+    //all members below are guarded by _mutex
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::vector<RowBatch*> _row_batches;
+    std::vector<RowBatch*> _free_row_batches;
+    //batch of each segment being filled with survivors
+    std::vector<RowBatch*> _pending_batches;
+    std::deque<SegmentTask> _ready_tasks;
+    //number of ready or running batches of each segment
+    std::vector<size_t> _num_tasks;
+    size_t _num_popping;
+    bool _input_done;
+    bool _stop;
+
+    size_t _batch_ylen;
+    int* _results{nullptr};
+
+    void _set_parameters(
+      const size_t num_inputs,
+      const size_t batch_size,
+      const size_t num_threads,
+      const size_t rebatch_interval,
+      const bool interleave,
+      const bool cache_block,
+      const size_t stationary_batches,
+      const size_t task_chunk
+    );
+
+    void _preprocess(const std::fs::path& input_path);
+
+    void  _infer();
+
+    void _run_worker(const size_t worker);
+
+    //runs every batch through all layers as a taskflow graph
+    //a lane fetches a batch, runs its chunks of layers as a chain of tasks,
+    //and fetches the next batch, as the cudaflow of SNIG<T>::_infer
+    void _run_task_graph();
+
+    //runs the layers of segment on the rows of Y
+    //survivors are left in _active_rows[worker]
+    //returns the buffer of _Y[worker] holding the output of the last layer
+    size_t _infer_batch(
+      const size_t worker,
+      const size_t segment,
+      T* batch_Y,
+      bool* batch_is_nonzero_row,
+      const std::vector<size_t>& inputs
+    );
+
+    //takes all rows of a batch with a nonzero section into _active_rows[worker]
+    //and builds their block masks
+    void _begin_batch(
+      const size_t worker,
+      T* batch_Y,
+      bool* batch_is_nonzero_row,
+      const std::vector<size_t>& inputs
+    );
+
+    //removes the rows of buffer whose sections are all zero from rows with category 0
+    //returns the number of retired rows
+    size_t _retire(
+      const size_t worker,
+      std::vector<size_t>& rows,
+      const size_t buffer,
+      const std::vector<size_t>& inputs
+    );
+
+    //runs layers [beg_layer, end_layer) on the live rows of worker whose input is in buffer cur
+    //returns the buffer holding the output of the last layer
+    size_t _infer_layers(
+      const size_t worker,
+      const size_t beg_layer,
+      const size_t end_layer,
+      size_t cur,
+      const std::vector<size_t>& inputs
+    );
+
+    //identifies the survivors if end_layer is the last layer
+    void _end_batch(
+      const size_t worker,
+      const size_t end_layer,
+      const std::vector<size_t>& inputs
+    );
+
+    //runs the layers of segment on the live rows of _active_rows[worker] in the interleaved layout
+    //survivors are unpacked into the rows of the first buffer of _Y[worker],
+    //or identified directly from their tiles in the last segment
+    void _infer_tiles(
+      const size_t worker,
+      const size_t segment,
+      const std::vector<size_t>& inputs
+    );
+
+    //moves the survivors of a batch of segment into the pending batch of segment + 1
+    //must be called with _mutex held
+    void _rebatch(
+      const size_t worker,
+      const size_t segment,
+      const size_t buffer,
+      const std::vector<size_t>& inputs
+    );
+
+    //moves pending batches whose upstream segments are drained to the ready tasks
+    //must be called with _mutex held
+    bool _flush_pending_batches();
+
+    RowBatch* _acquire_row_batch();
+
+    WeightLayout _layer_layout(const size_t layer) const;
+
+    //returns nullptr if the layer has settled on push
+    std::shared_ptr<const PullLayer<T> > _acquire_pull_layer(const size_t layer);
+
+    void _profile_layer(
+      const size_t layer,
+      const WeightLayout layout,
+      const uint64_t ns,
+      const size_t num_rows
+    );
+
+    void _input_alloc();
+
+    void _weight_alloc();
+
+    void _result_alloc();
+
+  public:
+
+    CPU(
+      const std::fs::path& weight_path,
+      const Real bias = -.3f,
+      const size_t num_neurons_per_layer = 1024,
+      const size_t num_layers = 120,
+      const bool map_weight = true,
+      const WeightLayout layout = WeightLayout::AUTO,
+      const bool compress_weight = false
+    );
+
+    ~CPU();
+
+    Eigen::Matrix<int, Eigen::Dynamic, 1> infer(
+      const std::fs::path& input_path,
+      const size_t num_inputs,
+      const size_t batch_size,
+      const size_t num_threads = std::thread::hardware_concurrency(),
+      const size_t rebatch_interval = 0,
+      const bool interleave = false,
+      const bool cache_block = false,
+      const size_t stationary_batches = 0,
+      const size_t task_chunk = 0
+    );
+
+};
+
+// ----------------------------------------------------------------------------
+// Definition of CPU
+// ----------------------------------------------------------------------------
+
+template <typename T>
+CPU<T>::CPU(
+  const std::fs::path& weight_path,
+  const Real bias,
+  const size_t num_neurons_per_layer,
+  const size_t num_layers,
+  const bool map_weight,
+  const WeightLayout layout,
+  const bool compress_weight
+):
+  //kernels take the bias in the unit of the accumulator from _acc_bias,
+  //so the bias of Base, which has the unit of T, is left unset
+  Base<T>(weight_path, T(), num_neurons_per_layer, num_layers, map_weight, compress_weight),
+  _acc_bias{ValueTraits<T>::bias(bias)},
+  _kernel{detect_cpu_kernel()},
+  _layout{layout}
+{
+  //layers of a compressed weight only exist in the push layout while they are decoded
+  if(Base<T>::_compressed_weight && _layout != WeightLayout::PUSH) {
+    Base<T>::log("Compressed weight only runs the PUSH weight layout", "\n");
+    _layout = WeightLayout::PUSH;
+  }
+  Base<T>::log("Constructing CPU engine......", "\n");
+}
+
+template <typename T>
+CPU<T>::~CPU() {
+  //stop the producer before its buffers are freed
+  _input_stream.reset();
+
+  for(auto& each_Y : _source_Y) {
+    delete [] each_Y;
+  }
+  for(auto& each_is_nonzero_row : _source_is_nonzero_row) {
+    delete [] each_is_nonzero_row;
+  }
+
+  for(auto& each_Y : _Y) {
+    delete [] each_Y[1];
+  }
+  for(auto& each_is_nonzero_row : _is_nonzero_row) {
+    delete [] each_is_nonzero_row[1];
+  }
+  for(auto& each_mask : _active_mask) {
+    delete [] each_mask[0];
+    delete [] each_mask[1];
+  }
+  for(auto& each_results : _sec_results) {
+    delete [] each_results;
+  }
+  for(auto& each_Y : _tile_Y) {
+    delete [] each_Y[0];
+    delete [] each_Y[1];
+  }
+  for(auto& each_is_nonzero_sec : _tile_is_nonzero_sec) {
+    delete [] each_is_nonzero_sec[0];
+    delete [] each_is_nonzero_sec[1];
+  }
+  for(auto& each_batch : _row_batches) {
+    delete [] each_batch->Y;
+    delete [] each_batch->is_nonzero_row;
+    delete each_batch;
+  }
+
+  delete [] _results;
+}
+
+template <typename T>
+Eigen::Matrix<int, Eigen::Dynamic, 1> CPU<T>::infer(
+  const std::fs::path& input_path,
+  const size_t num_inputs,
+  const size_t batch_size,
+  const size_t num_threads,
+  const size_t rebatch_interval,
+  const bool interleave,
+  const bool cache_block,
+  const size_t stationary_batches,
+  const size_t task_chunk
+) {
+
+  //interleaved tiles and a compressed weight run one layer at a time
+  _set_parameters(
+    num_inputs,
+    batch_size,
+    num_threads,
+    rebatch_interval,
+    interleave,
+    cache_block && !interleave && !Base<T>::_compressed_weight,
+    interleave ? 0 : stationary_batches,
+    (interleave || rebatch_interval > 0) ? 0 : task_chunk
+  );
+
+  Base<T>::log("Using ", num_threads, " threads", "\n");
+  Base<T>::log("Using ", cpu_kernel_name(_kernel), " kernel", "\n");
+  Base<T>::log("Using ", weight_layout_name(_layout), " weight layout", "\n");
+  Base<T>::log("Total input size : ", num_inputs, "\n");
+  //batches in lockstep count as one batch of all their rows
+  Base<T>::log("Input batch size : ", _batch_size, "\n");
+  Base<T>::log("Re-batching interval : ", rebatch_interval, " layers", "\n");
+  Base<T>::log("Interleaved activations : ", interleave ? "on" : "off", "\n");
+
+  if(_cache_block) {
+    Base<T>::log(
+      "Cache blocking : chunks of ", std::min(_block.chunk_rows, _batch_size),
+      " rows through ", std::min(_block.layer_depth, Base<T>::_num_layers), " layers", "\n\n"
+    );
+  }
+  else {
+    Base<T>::log("Cache blocking : off", "\n");
+  }
+  if(_stationary_batches > 0) {
+    Base<T>::log(
+      "Weight-stationary batches : ", _stationary_batches, " of ", stationary_batches, " requested",
+      ", blocks of ", _stationary_secs, " / ", Base<T>::_num_secs, " sections", "\n"
+    );
+  }
+  else {
+    Base<T>::log("Weight-stationary batches : off", "\n");
+  }
+  //the task graph runs every batch through all layers in the row layout
+  if(_task_chunk > 0) {
+    Base<T>::log("Task graph : chunks of ", _task_chunk, " layers, ", _num_lanes, " batches in flight", "\n\n");
+  }
+  else {
+    Base<T>::log("Task graph : off", "\n\n");
+  }
+
+  _preprocess(input_path);
+
+  _infer();
+
+  return arr_to_Eigen_int(_results, Base<T>::_num_inputs);
+}
+
+template <typename T>
+void CPU<T>::_set_parameters(
+  const size_t num_inputs,
+  const size_t batch_size,
+  const size_t num_threads,
+  const size_t rebatch_interval,
+  const bool interleave,
+  const bool cache_block,
+  const size_t stationary_batches,
+  const size_t task_chunk
+) {
+  Base<T>::_num_inputs = num_inputs;
+  _num_threads = std::max(num_threads, size_t{1});
+  _task_chunk = task_chunk;
+  _num_lanes = _task_chunk > 0 ? 2 * _num_threads : _num_threads;
+  _rebatch_interval = rebatch_interval;
+  _interleave = interleave;
+
+  //groups and weight blocks are sized to the largest layer in the packed layout
+  const CacheSizes cache = detect_cache_sizes();
+  const size_t layer_size = (Base<T>::_num_neurons * Base<T>::_num_secs + 1) * sizeof(int) +
+                            Base<T>::_max_nnz * (Base<T>::_short_index ? sizeof(uint16_t) : sizeof(int)) +
+                            Base<T>::_max_vals * sizeof(T);
+  _cache_block = cache_block;
+  if(_cache_block) {
+    _block = choose_cache_block(cache, Base<T>::_num_neurons, sizeof(T), layer_size, _num_threads);
+  }
+  _stationary_batches = stationary_batches;
+  _stationary_secs = Base<T>::_num_secs;
+  if(_stationary_batches > 0) {
+    _stationary_secs = choose_stationary_secs(cache, layer_size, Base<T>::_num_secs);
+  }
+
+  //batches in lockstep are fetched, retired and re-batched as one batch of their rows
+  //merging leaves fewer batches for the workers, so the number of batches in lockstep
+  //is lowered until there are at least as many merged batches as threads
+  //and no more batches in lockstep than input batches
+  //buffers never hold more rows than the input file, and at least one row
+  const size_t input_batch_size = std::max(std::min(batch_size, num_inputs), size_t{1});
+  while(
+    _stationary_batches > 1 && (
+      (num_inputs + input_batch_size * _stationary_batches - 1) / (input_batch_size * _stationary_batches) < _num_threads ||
+      input_batch_size * (_stationary_batches - 1) >= num_inputs
+    )
+  ) {
+    --_stationary_batches;
+  }
+  _batch_size = std::min(input_batch_size * std::max(_stationary_batches, size_t{1}), std::max(num_inputs, size_t{1}));
+  _batch_ylen = _batch_size * Base<T>::_num_neurons;
+
+  _Y.reserve(_num_lanes);
+  _is_nonzero_row.reserve(_num_lanes);
+  _active_mask.reserve(_num_lanes);
+  _mask_words = active_mask_words(Base<T>::_num_neurons);
+  _batch_mask.assign(_num_lanes, std::vector<uint64_t>(_mask_words));
+  _batch_columns.resize(_num_lanes);
+  _num_union_blocks = 0;
+  _num_layer_blocks = 0;
+  _sec_results.reserve(_num_lanes);
+  _chunk_rows.resize(_num_lanes);
+  _active_rows.resize(_num_lanes);
+  _batch_inputs.resize(_num_lanes);
+  _active_tiles.resize(_num_lanes);
+  _num_retired_rows = 0;
+
+  //0 runs every batch through all layers
+  size_t interval = (_rebatch_interval == 0) ? Base<T>::_num_layers : _rebatch_interval;
+  _segments.clear();
+  for(size_t l = 0; l < Base<T>::_num_layers; l += interval) {
+    _segments.push_back(l);
+  }
+  _segments.push_back(Base<T>::_num_layers);
+
+  size_t num_segments = _segments.size() - 1;
+  _pending_batches.assign(num_segments, nullptr);
+  _num_tasks.assign(num_segments, 0);
+  _num_popping = 0;
+  _input_done = false;
+  _stop = false;
+}
+
+template <typename T>
+void CPU<T>::_preprocess(const std::fs::path& input_path) {
+  Base<T>::log("Preprocessing...... ");
+  Base<T>::tic();
+
+  //weight allocation
+  _weight_alloc();
+  //input allocation
+  _input_alloc();
+  //final results allocation
+  _result_alloc();
+
+  //start streaming input
+  _input_stream = std::make_unique<InputStream<T> >(
+    input_path,
+    Base<T>::_num_inputs,
+    _batch_size,
+    Base<T>::_num_neurons,
+    Base<T>::_sec_size,
+    Base<T>::_num_secs,
+    _source_Y,
+    _source_is_nonzero_row
+  );
+
+  Base<T>::toc();
+  Base<T>::log("Finish preprocessing with ", Base<T>::duration(), " ms", "\n");
+}
+
+template <typename T>
+void CPU<T>::_infer() {
+  Base<T>::log("Start inference...... ", "\n");
+  Base<T>::tic();
+
+  if(_task_chunk > 0) {
+    _run_task_graph();
+  }
+  else {
+    std::vector<std::exception_ptr> errors(_num_threads);
+
+    //each thread takes ready batches of survivors first,
+    //then fetches the next staged batch until all inputs are consumed
+    #pragma omp parallel num_threads(_num_threads)
+    {
+      size_t worker = omp_get_thread_num();
+      try {
+        _run_worker(worker);
+      }
+      catch(...) {
+        errors[worker] = std::current_exception();
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+        _cv.notify_all();
+      }
+    }
+
+    for(auto& error : errors) {
+      if(error) {
+        std::rethrow_exception(error);
+      }
+    }
+  }
+
+  Base<T>::toc();
+  Base<T>::log("Finish inference with ", Base<T>::duration(), " ms", "\n");
+
+  if(_layout == WeightLayout::AUTO && !_interleave) {
+    size_t num_pull = 0;
+    for(size_t l = 0; l < Base<T>::_num_layers; ++l) {
+      num_pull += (_layer_layout(l) == WeightLayout::PULL);
+    }
+    Base<T>::log("Layers using the pull layout : ", num_pull, " / ", Base<T>::_num_layers, "\n");
+  }
+  if(!_interleave) {
+    Base<T>::log(
+      "Weight columns read by batches : ",
+      100.0 * _num_union_blocks.load() / std::max<size_t>(_num_layer_blocks.load(), 1), " %", "\n"
+    );
+  }
+  Base<T>::log("Inputs retired before the last layer : ", _num_retired_rows.load(), "\n");
+}
+
+template <typename T>
+void CPU<T>::_run_worker(const size_t worker) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while(!_stop) {
+    //survivors go first, so pending rows do not pile up
+    if(!_ready_tasks.empty()) {
+      SegmentTask task = _ready_tasks.front();
+      _ready_tasks.pop_front();
+      lock.unlock();
+
+      size_t buffer = _infer_batch(worker, task.segment, task.batch->Y, task.batch->is_nonzero_row, task.batch->inputs);
+
+      lock.lock();
+      _rebatch(worker, task.segment, buffer, task.batch->inputs);
+      _free_row_batches.push_back(task.batch);
+      --_num_tasks[task.segment];
+      _cv.notify_all();
+      continue;
+    }
+
+    if(!_input_done) {
+      ++_num_popping;
+      lock.unlock();
+
+      InputBatch<T> batch;
+      if(!_input_stream->pop(batch)) {
+        lock.lock();
+        --_num_popping;
+        _input_done = true;
+        _cv.notify_all();
+        continue;
+      }
+
+      lock.lock();
+      --_num_popping;
+      ++_num_tasks[0];
+      lock.unlock();
+
+      std::vector<size_t>& inputs = _batch_inputs[worker];
+      inputs.resize(batch.num_rows);
+      for(size_t r = 0; r < batch.num_rows; ++r) {
+        inputs[r] = batch.beg_inputs + r;
+      }
+      size_t buffer = _infer_batch(worker, 0, batch.Y, batch.is_nonzero_row, inputs);
+
+      lock.lock();
+      _rebatch(worker, 0, buffer, inputs);
+      --_num_tasks[0];
+      _cv.notify_all();
+      lock.unlock();
+
+      //survivors are copied out, so the batch buffer goes back to the stream
+      _input_stream->release(batch);
+
+      lock.lock();
+      continue;
+    }
+
+    if(_flush_pending_batches()) {
+      _cv.notify_all();
+      continue;
+    }
+
+    if(
+      _num_popping == 0 &&
+      std::all_of(_num_tasks.begin(), _num_tasks.end(), [](size_t n){ return n == 0; }) &&
+      std::all_of(_pending_batches.begin(), _pending_batches.end(), [](RowBatch* b){ return b == nullptr; })
+    ) {
+      break;
+    }
+    _cv.wait(lock);
+  }
+}
+
+template <typename T>
+void CPU<T>::_run_task_graph() {
+  const size_t num_layers = Base<T>::_num_layers;
+  const size_t num_chunks = (num_layers + _task_chunk - 1) / _task_chunk;
+
+  tf::Taskflow taskflow("CPU");
+  tf::Executor executor(_num_threads);
+
+  //batch of each lane and the buffer holding its latest output
+  std::vector<InputBatch<T> > lane_batches(_num_lanes);
+  std::vector<size_t> lane_buffers(_num_lanes, 0);
+
+  //the first exception is kept and every lane stops at its next task
+  std::exception_ptr error;
+  std::atomic<bool> failed{false};
+  auto guard = [&](auto&& work) {
+    if(failed) {
+      return;
+    }
+    try {
+      work();
+    }
+    catch(...) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if(!error) {
+        error = std::current_exception();
+      }
+      failed = true;
+    }
+  };
+
+  //the previous batch of lane has finished, so its buffer goes back to the ring
+  auto fetch = [&](const size_t lane) {
+    int is_end = 1;
+    guard([&](){
+      InputBatch<T>& batch = lane_batches[lane];
+      if(batch.Y != nullptr) {
+        _input_stream->release(batch);
+        batch = InputBatch<T>{};
+      }
+      if(!_input_stream->pop(batch)) {
+        batch = InputBatch<T>{};
+        return;
+      }
+      std::vector<size_t>& inputs = _batch_inputs[lane];
+      inputs.resize(batch.num_rows);
+      for(size_t r = 0; r < batch.num_rows; ++r) {
+        inputs[r] = batch.beg_inputs + r;
+      }
+      _begin_batch(lane, batch.Y, batch.is_nonzero_row, inputs);
+      lane_buffers[lane] = 0;
+      is_end = 0;
+    });
+    return is_end;
+  };
+
+  tf::Task start = taskflow.emplace([](){
+  }).name("start");
+
+  tf::Task stop = taskflow.emplace([](){
+  }).name("stop");
+
+  for(size_t lane = 0; lane < _num_lanes; ++lane) {
+    tf::Task first_fetch = taskflow.emplace([&, lane](){
+      return fetch(lane);
+    }).name("first_fetch");
+
+    std::vector<tf::Task> chunks;
+    chunks.reserve(num_chunks);
+    for(size_t c = 0; c < num_chunks; ++c) {
+      chunks.emplace_back(taskflow.emplace([&, lane, c](){
+        guard([&](){
+          size_t beg_layer = c * _task_chunk;
+          size_t end_layer = std::min(beg_layer + _task_chunk, num_layers);
+          lane_buffers[lane] = _infer_layers(lane, beg_layer, end_layer, lane_buffers[lane], _batch_inputs[lane]);
+          _end_batch(lane, end_layer, _batch_inputs[lane]);
+        });
+      }).name("layers"));
+    }
+
+    tf::Task next_fetch = taskflow.emplace([&, lane](){
+      return fetch(lane);
+    }).name("fetch");
+
+    //dependencies of taskflow
+    start.precede(first_fetch);
+    first_fetch.precede(chunks.front(), stop);
+    for(size_t c = 0; c + 1 < num_chunks; ++c) {
+      chunks[c].precede(chunks[c + 1]);
+    }
+    chunks.back().precede(next_fetch);
+    next_fetch.precede(chunks.front(), stop);
+  }
+
+  executor.run(taskflow).wait();
+
+  //a failed lane may still hold its batch
+  for(auto& batch : lane_batches) {
+    if(batch.Y != nullptr) {
+      _input_stream->release(batch);
+    }
+  }
+  if(error) {
+    std::rethrow_exception(error);
+  }
+}
+
+template <typename T>
+size_t CPU<T>::_infer_batch(
+  const size_t worker,
+  const size_t segment,
+  T* batch_Y,
+  bool* batch_is_nonzero_row,
+  const std::vector<size_t>& inputs
+) {
+  const size_t beg_layer = _segments[segment];
+  const size_t end_layer = _segments[segment + 1];
+
+  _begin_batch(worker, batch_Y, batch_is_nonzero_row, inputs);
+
+  size_t cur = 0;
+  if(_interleave) {
+    _infer_tiles(worker, segment, inputs);
+    size_t num_retired = _retire(worker, _active_rows[worker], 0, inputs);
+    if(end_layer < Base<T>::_num_layers) {
+      _num_retired_rows += num_retired;
+    }
+  }
+  else {
+    cur = _infer_layers(worker, beg_layer, end_layer, 0, inputs);
+  }
+
+  _end_batch(worker, end_layer, inputs);
+  return cur;
+}
+
+template <typename T>
+void CPU<T>::_begin_batch(
+  const size_t worker,
+  T* batch_Y,
+  bool* batch_is_nonzero_row,
+  const std::vector<size_t>& inputs
+) {
+  const size_t num_neurons = Base<T>::_num_neurons;
+  const size_t num_secs = Base<T>::_num_secs;
+
+  _Y[worker][0] = batch_Y;
+  _is_nonzero_row[worker][0] = batch_is_nonzero_row;
+
+  std::vector<size_t>& active_rows = _active_rows[worker];
+  active_rows.clear();
+  for(size_t r = 0; r < inputs.size(); ++r) {
+    active_rows.push_back(r);
+  }
+  _retire(worker, active_rows, 0, inputs);
+
+  //tiles keep their own section flags
+  if(_interleave) {
+    return;
+  }
+  for(auto r : active_rows) {
+    build_active_mask<T>(
+      batch_Y + r * num_neurons,
+      batch_is_nonzero_row + r * num_secs,
+      Base<T>::_sec_size,
+      num_secs,
+      _active_mask[worker][0] + r * _mask_words
+    );
+  }
+}
+
+//rows are retired in place, the survivors stay in input order
+template <typename T>
+size_t CPU<T>::_retire(
+  const size_t worker,
+  std::vector<size_t>& rows,
+  const size_t buffer,
+  const std::vector<size_t>& inputs
+) {
+  const size_t num_secs = Base<T>::_num_secs;
+  size_t num_active = 0;
+  for(auto r : rows) {
+    const bool* row_flags = _is_nonzero_row[worker][buffer] + r * num_secs;
+    if(std::none_of(row_flags, row_flags + num_secs, [](bool f){ return f; })) {
+      _results[inputs[r]] = 0;
+      continue;
+    }
+    rows[num_active++] = r;
+  }
+  size_t num_retired = rows.size() - num_active;
+  rows.resize(num_active);
+  return num_retired;
+}
+
+template <typename T>
+size_t CPU<T>::_infer_layers(
+  const size_t worker,
+  const size_t beg_layer,
+  const size_t end_layer,
+  size_t cur,
+  const std::vector<size_t>& inputs
+) {
+  const size_t num_neurons = Base<T>::_num_neurons;
+  const size_t num_secs = Base<T>::_num_secs;
+
+  std::vector<T*>& Y = _Y[worker];
+  std::vector<bool*>& is_nonzero_row = _is_nonzero_row[worker];
+  std::vector<uint64_t*>& active_mask = _active_mask[worker];
+  uint64_t* batch_mask = _batch_mask[worker].data();
+  std::vector<std::pair<size_t, size_t> >& batch_columns = _batch_columns[worker];
+  std::vector<size_t>& active_rows = _active_rows[worker];
+
+  //a column of layer is read only if its input is nonzero in a live row,
+  //so a push layer needs the column ranges of the union of the masks
+  //groups of several layers read whole layers, the union only counts their first layer
+  const size_t depth = _cache_block ? _block.layer_depth : 1;
+  auto prefetch_columns = [&](const size_t buffer, const size_t layer) {
+    clear_active_mask(batch_mask, num_neurons);
+    for(auto r : active_rows) {
+      union_active_mask(active_mask[buffer] + r * _mask_words, num_neurons, batch_mask);
+    }
+    _num_union_blocks += count_active_blocks(batch_mask, num_neurons);
+    _num_layer_blocks += active_mask_blocks(num_neurons);
+    if(Base<T>::_mapped_weight && depth == 1 && _layer_layout(layer) != WeightLayout::PULL) {
+      active_ranges(batch_mask, num_neurons, batch_columns);
+      Base<T>::_prefetch_weight_columns(layer, batch_columns);
+    }
+  };
+
+  //runs cur_layer on rows from buffer cur into buffer 1 - cur
+  auto run_layer = [&](const size_t cur_layer, const std::vector<size_t>& rows, const size_t cur) {
+    Base<T>::_prefetch_weight(cur_layer + 1);
+
+    WeightLayout layout = _layer_layout(cur_layer);
+
+    //a layer may settle on push between choosing its layout and acquiring it
+    //the transposition of the first pull run is not timed
+    std::shared_ptr<const PullLayer<T> > pull_layer;
+    if(layout == WeightLayout::PULL) {
+      pull_layer = _acquire_pull_layer(cur_layer);
+      if(!pull_layer) {
+        layout = WeightLayout::PUSH;
+      }
+    }
+    auto beg = std::chrono::steady_clock::now();
+
+    //each block of output sections runs on all rows before the next block,
+    //a single block of all sections unless weight-stationary
+    if(layout == WeightLayout::PULL) {
+      const PullLayer<T>& pull = *pull_layer;
+      for(size_t beg_sec = 0, end_sec; beg_sec < num_secs; beg_sec = end_sec) {
+        end_sec = std::min(beg_sec + _stationary_secs, num_secs);
+        for(auto r : rows) {
+          cpu_pull_inference<T>(
+            Y[cur] + r * num_neurons,
+            is_nonzero_row[cur] + r * num_secs,
+            Base<T>::_sec_size,
+            num_secs,
+            num_neurons,
+            beg_sec,
+            end_sec,
+            pull.row_p.data(),
+            pull.col_p.data(),
+            pull.val_p.data(),
+            Base<T>::_uniform_w(cur_layer),
+            _acc_bias,
+            is_nonzero_row[1 - cur] + r * num_secs,
+            active_mask[1 - cur] + r * _mask_words,
+            Y[1 - cur] + r * num_neurons
+          );
+        }
+      }
+    }
+    else {
+      Base<T>::_acquire_weight(cur_layer);
+
+      // transformed CSC weight matrix equals to CSR with exchanged row and col
+      const int* col_w = Base<T>::_col_w(cur_layer);
+      const T* val_w = Base<T>::_val_w(cur_layer);
+
+      //row_w is either int or uint16_t
+      auto infer_rows = [&](const auto* row_w) {
+        for(size_t beg_sec = 0, end_sec; beg_sec < num_secs; beg_sec = end_sec) {
+          end_sec = std::min(beg_sec + _stationary_secs, num_secs);
+          for(auto r : rows) {
+            cpu_inference_dispatch<T>(
+              _kernel,
+              Y[cur] + r * num_neurons,
+              is_nonzero_row[cur] + r * num_secs,
+              active_mask[cur] + r * _mask_words,
+              Base<T>::_sec_size,
+              num_secs,
+              num_neurons,
+              beg_sec,
+              end_sec,
+              col_w,
+              row_w,
+              val_w,
+              Base<T>::_uniform_w(cur_layer),
+              _acc_bias,
+              is_nonzero_row[1 - cur] + r * num_secs,
+              active_mask[1 - cur] + r * _mask_words,
+              Y[1 - cur] + r * num_neurons,
+              _sec_results[worker]
+            );
+          }
+        }
+      };
+      if(Base<T>::_short_index) {
+        infer_rows(Base<T>::_short_row_w(cur_layer));
+      }
+      else {
+        infer_rows(Base<T>::_row_w(cur_layer));
+      }
+
+      Base<T>::_release_weight(cur_layer);
+    }
+
+    if(_layout == WeightLayout::AUTO) {
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - beg).count();
+      _profile_layer(cur_layer, layout, ns, rows.size());
+    }
+  };
+
+  //without cache blocking, a group is one layer and a chunk holds all live rows
+  //every chunk runs through all layers of a group, so the buffer of the survivors
+  //flips once per layer of the group
+  std::vector<size_t>& chunk = _chunk_rows[worker];
+  const size_t chunk_rows = _cache_block ? _block.chunk_rows : ~size_t(0);
+  for(size_t group_beg = beg_layer; group_beg < end_layer && !active_rows.empty(); group_beg += depth) {
+    const size_t group_end = std::min(group_beg + depth, end_layer);
+    prefetch_columns(cur, group_beg);
+
+    size_t num_active = 0;
+    for(size_t chunk_beg = 0, chunk_end; chunk_beg < active_rows.size(); chunk_beg = chunk_end) {
+      chunk_end = chunk_beg + std::min(chunk_rows, active_rows.size() - chunk_beg);
+      chunk.assign(active_rows.begin() + chunk_beg, active_rows.begin() + chunk_end);
+      size_t chunk_cur = cur;
+      for(size_t cur_layer = group_beg; cur_layer < group_end && !chunk.empty(); ++cur_layer) {
+        run_layer(cur_layer, chunk, chunk_cur);
+        chunk_cur = 1 - chunk_cur;
+        size_t num_retired = _retire(worker, chunk, chunk_cur, inputs);
+        if(cur_layer + 1 < Base<T>::_num_layers) {
+          _num_retired_rows += num_retired;
+        }
+      }
+      //survivors of earlier chunks never overtake the rows of later chunks
+      for(auto r : chunk) {
+        active_rows[num_active++] = r;
+      }
+    }
+    active_rows.resize(num_active);
+    cur = ((group_end - group_beg) % 2 == 0) ? cur : 1 - cur;
+  }
+  return cur;
+}
+
+//survivors of the last layer have nonzero activations
+template <typename T>
+void CPU<T>::_end_batch(
+  const size_t worker,
+  const size_t end_layer,
+  const std::vector<size_t>& inputs
+) {
+  if(end_layer == Base<T>::_num_layers) {
+    for(auto r : _active_rows[worker]) {
+      _results[inputs[r]] = 1;
+    }
+    _active_rows[worker].clear();
+  }
+}
+
+template <typename T>
+void CPU<T>::_infer_tiles(
+  const size_t worker,
+  const size_t segment,
+  const std::vector<size_t>& inputs
+) {
+  const size_t num_neurons = Base<T>::_num_neurons;
+  const size_t sec_size = Base<T>::_sec_size;
+  const size_t num_secs = Base<T>::_num_secs;
+  const size_t tile_len = num_neurons * TILE_WIDTH;
+  const size_t beg_layer = _segments[segment];
+  const size_t end_layer = _segments[segment + 1];
+
+  std::vector<size_t>& active_rows = _active_rows[worker];
+  std::vector<T*>& tile_Y = _tile_Y[worker];
+  std::vector<bool*>& tile_is_nonzero_sec = _tile_is_nonzero_sec[worker];
+  std::vector<size_t>& active_tiles = _active_tiles[worker];
+
+  //tile t holds rows active_rows[t * TILE_WIDTH, (t + 1) * TILE_WIDTH)
+  const size_t num_tiles = (active_rows.size() + TILE_WIDTH - 1) / TILE_WIDTH;
+  auto tile_rows = [&](const size_t t) {
+    return std::min(TILE_WIDTH, active_rows.size() - t * TILE_WIDTH);
+  };
+
+  //layout conversion at fetch
+  active_tiles.clear();
+  for(size_t t = 0; t < num_tiles; ++t) {
+    interleave_rows<T>(
+      _Y[worker][0],
+      _is_nonzero_row[worker][0],
+      active_rows.data() + t * TILE_WIDTH,
+      tile_rows(t),
+      sec_size,
+      num_secs,
+      num_neurons,
+      tile_Y[0] + t * tile_len,
+      tile_is_nonzero_sec[0] + t * num_secs
+    );
+    active_tiles.push_back(t);
+  }
+
+  size_t cur = 0;
+  for(size_t cur_layer = beg_layer; cur_layer < end_layer && !active_tiles.empty(); ++cur_layer) {
+    Base<T>::_prefetch_weight(cur_layer + 1);
+    Base<T>::_acquire_weight(cur_layer);
+
+    // transformed CSC weight matrix equals to CSR with exchanged row and col
+    const int* col_w = Base<T>::_col_w(cur_layer);
+    const T* val_w = Base<T>::_val_w(cur_layer);
+
+    //row_w is either int or uint16_t
+    auto infer_tiles = [&](const auto* row_w) {
+      for(auto t : active_tiles) {
+        cpu_tile_inference_dispatch<T>(
+          _kernel,
+          tile_Y[cur] + t * tile_len,
+          tile_is_nonzero_sec[cur] + t * num_secs,
+          sec_size,
+          num_secs,
+          num_neurons,
+          col_w,
+          row_w,
+          val_w,
+          Base<T>::_uniform_w(cur_layer),
+          _acc_bias,
+          tile_is_nonzero_sec[1 - cur] + t * num_secs,
+          tile_Y[1 - cur] + t * tile_len,
+          _sec_results[worker]
+        );
+      }
+    };
+    if(Base<T>::_short_index) {
+      infer_tiles(Base<T>::_short_row_w(cur_layer));
+    }
+    else {
+      infer_tiles(Base<T>::_row_w(cur_layer));
+    }
+    Base<T>::_release_weight(cur_layer);
+    cur = 1 - cur;
+
+    //a tile is retired once all of its lanes are zero
+    //flags of both buffers are cleared, so the tile reads as empty when unpacked
+    size_t num_active = 0;
+    for(auto t : active_tiles) {
+      bool* flags = tile_is_nonzero_sec[cur] + t * num_secs;
+      if(std::none_of(flags, flags + num_secs, [](bool f){ return f; })) {
+        std::fill(tile_is_nonzero_sec[1 - cur] + t * num_secs, tile_is_nonzero_sec[1 - cur] + (t + 1) * num_secs, false);
+        //rows of earlier segments are counted when they are unpacked
+        if(end_layer == Base<T>::_num_layers && cur_layer + 1 < Base<T>::_num_layers) {
+          _num_retired_rows += tile_rows(t);
+        }
+        continue;
+      }
+      active_tiles[num_active++] = t;
+    }
+    active_tiles.resize(num_active);
+  }
+
+  //result stage, categories of the last segment come straight from the tiles
+  if(end_layer == Base<T>::_num_layers) {
+    int categories[TILE_WIDTH];
+    for(size_t t = 0; t < num_tiles; ++t) {
+      cpu_identify_tile<T>(
+        tile_Y[cur] + t * tile_len,
+        tile_is_nonzero_sec[cur] + t * num_secs,
+        tile_rows(t),
+        sec_size,
+        num_secs,
+        categories
+      );
+      for(size_t l = 0; l < tile_rows(t); ++l) {
+        _results[inputs[active_rows[t * TILE_WIDTH + l]]] = categories[l];
+      }
+    }
+    active_rows.clear();
+    return;
+  }
+
+  //layout conversion back to rows for re-batching
+  for(size_t t = 0; t < num_tiles; ++t) {
+    deinterleave_rows<T>(
+      tile_Y[cur] + t * tile_len,
+      tile_is_nonzero_sec[cur] + t * num_secs,
+      active_rows.data() + t * TILE_WIDTH,
+      tile_rows(t),
+      sec_size,
+      num_secs,
+      num_neurons,
+      _Y[worker][0],
+      _is_nonzero_row[worker][0]
+    );
+  }
+}
+
+template <typename T>
+void CPU<T>::_rebatch(
+  const size_t worker,
+  const size_t segment,
+  const size_t buffer,
+  const std::vector<size_t>& inputs
+) {
+  const size_t num_neurons = Base<T>::_num_neurons;
+  const size_t num_secs = Base<T>::_num_secs;
+
+  for(auto r : _active_rows[worker]) {
+    RowBatch*& pending = _pending_batches[segment + 1];
+    if(pending == nullptr) {
+      pending = _acquire_row_batch();
+    }
+
+    size_t slot = pending->inputs.size();
+    cpu_copy_row<T>(
+      _Y[worker][buffer] + r * num_neurons,
+      _is_nonzero_row[worker][buffer] + r * num_secs,
+      Base<T>::_sec_size,
+      num_secs,
+      pending->Y + slot * num_neurons,
+      pending->is_nonzero_row + slot * num_secs
+    );
+    pending->inputs.push_back(inputs[r]);
+
+    if(pending->inputs.size() == _batch_size) {
+      _ready_tasks.push_back(SegmentTask{segment + 1, pending});
+      ++_num_tasks[segment + 1];
+      pending = nullptr;
+    }
+  }
+  _active_rows[worker].clear();
+}
+
+template <typename T>
+bool CPU<T>::_flush_pending_batches() {
+  //a pending batch can only grow while batches of earlier segments are in flight
+  bool is_upstream_busy = !_input_done || _num_popping > 0;
+  bool is_flushed = false;
+  for(size_t s = 1; s < _pending_batches.size(); ++s) {
+    is_upstream_busy = is_upstream_busy || _num_tasks[s - 1] > 0;
+    if(is_upstream_busy) {
+      break;
+    }
+    if(_pending_batches[s] != nullptr) {
+      _ready_tasks.push_back(SegmentTask{s, _pending_batches[s]});
+      ++_num_tasks[s];
+      _pending_batches[s] = nullptr;
+      is_flushed = true;
+      is_upstream_busy = true;
+    }
+  }
+  return is_flushed;
+}
+
+template <typename T>
+typename CPU<T>::RowBatch* CPU<T>::_acquire_row_batch() {
+  if(!_free_row_batches.empty()) {
+    RowBatch* batch = _free_row_batches.back();
+    _free_row_batches.pop_back();
+    batch->inputs.clear();
+    return batch;
+  }
+
+  //row batches start zeroed with all flags false, like every other batch buffer
+  RowBatch* batch = new RowBatch;
+  batch->Y = new T[_batch_ylen]();
+  batch->is_nonzero_row = new bool[_batch_size * Base<T>::_num_secs]();
+  batch->inputs.reserve(_batch_size);
+  _row_batches.push_back(batch);
+  return batch;
+}
+
+//undecided layers of AUTO mode alternate between layouts
+//so that both are measured on the same number of batches
+template <typename T>
+WeightLayout CPU<T>::_layer_layout(const size_t layer) const {
+  if(_layout != WeightLayout::AUTO) {
+    return _layout;
+  }
+  const LayerProfile& profile = _profiles[layer];
+  WeightLayout layout = static_cast<WeightLayout>(profile.layout.load(std::memory_order_relaxed));
+  if(layout != WeightLayout::AUTO) {
+    return layout;
+  }
+  return profile.batches[0].load(std::memory_order_relaxed) <= profile.batches[1].load(std::memory_order_relaxed) ?
+         WeightLayout::PUSH : WeightLayout::PULL;
+}
+
+template <typename T>
+std::shared_ptr<const PullLayer<T> > CPU<T>::_acquire_pull_layer(const size_t layer) {
+  PullSlot& slot = _pull_layers[layer];
+  std::call_once(slot.built, [&](){
+    auto pull = std::make_shared<PullLayer<T> >();
+    auto build = [&](const auto* row_w) {
+      build_pull_layer<T>(
+        Base<T>::_col_w(layer),
+        row_w,
+        Base<T>::_val_w(layer),
+        Base<T>::_uniform_w(layer),
+        Base<T>::_sec_size,
+        Base<T>::_num_secs,
+        Base<T>::_num_neurons,
+        *pull
+      );
+    };
+    if(Base<T>::_short_index) {
+      build(Base<T>::_short_row_w(layer));
+    }
+    else {
+      build(Base<T>::_row_w(layer));
+    }
+    std::atomic_store(&slot.layer, std::shared_ptr<const PullLayer<T> >(std::move(pull)));
+  });
+  return std::atomic_load(&slot.layer);
+}
+
+template <typename T>
+void CPU<T>::_profile_layer(
+  const size_t layer,
+  const WeightLayout layout,
+  const uint64_t ns,
+  const size_t num_rows
+) {
+  //number of batches each layout is measured on
+  constexpr int num_profile_batches = 2;
+
+  LayerProfile& profile = _profiles[layer];
+  if(static_cast<WeightLayout>(profile.layout.load(std::memory_order_relaxed)) != WeightLayout::AUTO) {
+    return;
+  }
+
+  int v = (layout == WeightLayout::PUSH) ? 0 : 1;
+  profile.ns[v] += ns;
+  profile.rows[v] += num_rows;
+  ++profile.batches[v];
+
+  if(profile.batches[0] >= num_profile_batches && profile.batches[1] >= num_profile_batches) {
+    //compare time per row, batches may be partial
+    double push = double(profile.ns[0]) / std::max<uint64_t>(profile.rows[0], 1);
+    double pull = double(profile.ns[1]) / std::max<uint64_t>(profile.rows[1], 1);
+    profile.layout = static_cast<int>(pull < push ? WeightLayout::PULL : WeightLayout::PUSH);
+    //workers running the layer as pull keep their reference
+    if(pull >= push) {
+      std::atomic_store(&_pull_layers[layer].layer, std::shared_ptr<const PullLayer<T> >());
+    }
+  }
+}
+
+template <typename T>
+void CPU<T>::_weight_alloc() {
+  //weights are read in place
+  //only the per-thread section accumulators are needed
+  //tiles accumulate TILE_WIDTH lanes per neuron
+  size_t results_len = Base<T>::_sec_size * (_interleave ? TILE_WIDTH : 1);
+  for(size_t w = 0; w < _num_lanes; ++w) {
+    _sec_results.push_back(new Acc[results_len]);
+  }
+
+  //batches of rows advise the columns they read,
+  //tiles and groups of several layers advise whole layers
+  //the mode is set before the first layers are advised
+  if(Base<T>::_mapped_weight) {
+    Base<T>::_mapped_weight->column_readahead(!_interleave && !(_cache_block && _block.layer_depth > 1));
+  }
+  Base<T>::_prefetch_weight(0);
+
+  //every worker pins one layer, the other slots hold layers decoded ahead
+  if(Base<T>::_compressed_weight) {
+    Base<T>::_compressed_weight->reserve(2 * _num_threads + 2);
+  }
+
+  //pull layouts are transposed from the packed weight when a layer first runs as pull,
+  //so a mapped weight is only read by the layers and columns inference touches
+  //tiles only run on the packed weight
+  if(_layout != WeightLayout::PUSH && !_interleave) {
+    _pull_layers.reset(new PullSlot[Base<T>::_num_layers]);
+  }
+  if(_layout == WeightLayout::AUTO && !_interleave) {
+    _profiles.reset(new LayerProfile[Base<T>::_num_layers]());
+  }
+}
+
+template <typename T>
+void CPU<T>::_input_alloc() {
+  //one batch in flight per lane and one staged per thread
+  for(size_t b = 0; b < _num_lanes + _num_threads; ++b) {
+    _source_Y.push_back(new T[_batch_ylen]());
+    _source_is_nonzero_row.push_back(new bool[_batch_size * Base<T>::_num_secs]());
+  }
+
+  std::vector<T*> Y{2, nullptr};
+  std::vector<bool*> is_nonzero_row{2, nullptr};
+  for(size_t w = 0; w < _num_lanes; ++w) {
+    Y[1] = new T[_batch_ylen]();
+    is_nonzero_row[1] = new bool[_batch_size * Base<T>::_num_secs]();
+    _Y.push_back(Y);
+    _is_nonzero_row.push_back(is_nonzero_row);
+    _active_mask.push_back({new uint64_t[_batch_size * _mask_words](), new uint64_t[_batch_size * _mask_words]()});
+  }
+
+  if(_interleave) {
+    size_t num_tiles = (_batch_size + TILE_WIDTH - 1) / TILE_WIDTH;
+    for(size_t w = 0; w < _num_lanes; ++w) {
+      std::vector<T*> tile_Y(2);
+      std::vector<bool*> tile_is_nonzero_sec(2);
+      for(size_t b = 0; b < 2; ++b) {
+        tile_Y[b] = new T[num_tiles * Base<T>::_num_neurons * TILE_WIDTH];
+        tile_is_nonzero_sec[b] = new bool[num_tiles * Base<T>::_num_secs]();
+      }
+      _tile_Y.push_back(tile_Y);
+      _tile_is_nonzero_sec.push_back(tile_is_nonzero_sec);
+    }
+  }
+}
+
+template <typename T>
+void CPU<T>::_result_alloc() {
+  _results = new int[Base<T>::_num_inputs]();
+}
+
+}// end of namespace snig ----------------------------------------------
@@ -0,0 +1,239 @@
+#pragma once
+#include <algorithm>
+#include <SNIG/cpu/kernel.hpp>
+#include <SNIG/utility/fixed_point.hpp>
+
+namespace snig{
+
+//Batch-interleaved activation layout of the CPU engine
+//A tile holds TILE_WIDTH inputs stored neuron-major:
+//neuron j of lane l is at Y_tile[j * TILE_WIDTH + l].
+//Each weight nonzero then updates all lanes of a tile
+//with one broadcast multiply-add on contiguous memory.
+//A tile keeps one flag per section, true if any lane of the section is nonzero.
+//Sections flagged false are never read, so their values may be stale.
+
+constexpr size_t TILE_WIDTH = 16;
+
+template <typename T>
+void interleave_rows(
+  const T* Y,
+  const bool* is_nonzero_row,
+  const size_t* rows,
+  const size_t num_rows,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  T* Y_tile,
+  bool* is_nonzero_sec
+);
+
+template <typename T>
+void deinterleave_rows(
+  const T* Y_tile,
+  const bool* is_nonzero_sec,
+  const size_t* rows,
+  const size_t num_rows,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  T* Y,
+  bool* is_nonzero_row
+);
+
+template <typename T, typename R>
+void cpu_tile_inference(
+  const T* Y_0,
+  const bool* is_nonzero_sec_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  const int* col_w,
+  const R* row_w,
+  const T* val_w,
+  const bool uniform_w,
+  const typename ValueTraits<T>::acc_type bias,
+  bool* is_nonzero_sec_1,
+  T* Y_1,
+  typename ValueTraits<T>::acc_type* results
+);
+
+template <typename T>
+void cpu_identify_tile(
+  const T* Y_tile,
+  const bool* is_nonzero_sec,
+  const size_t num_rows,
+  const size_t sec_size,
+  const size_t num_secs,
+  int* result_arr
+);
+
+//-----------------------------------------------------------------------------
+//Definition of interleave function
+//-----------------------------------------------------------------------------
+
+//gathers num_rows (at most TILE_WIDTH) rows of a row-major batch into one tile
+//unused lanes are zero
+template <typename T>
+void interleave_rows(
+  const T* Y,
+  const bool* is_nonzero_row,
+  const size_t* rows,
+  const size_t num_rows,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  T* Y_tile,
+  bool* is_nonzero_sec
+) {
+  for(size_t s = 0; s < num_secs; ++s) {
+    bool is_nonzero = false;
+    for(size_t l = 0; l < num_rows; ++l) {
+      is_nonzero |= is_nonzero_row[rows[l] * num_secs + s];
+    }
+    is_nonzero_sec[s] = is_nonzero;
+    if(!is_nonzero) {
+      continue;
+    }
+
+    T* sec_tile = Y_tile + s * sec_size * TILE_WIDTH;
+    for(size_t l = 0; l < TILE_WIDTH; ++l) {
+      if(l < num_rows && is_nonzero_row[rows[l] * num_secs + s]) {
+        const T* y = Y + rows[l] * num_neurons + s * sec_size;
+        for(size_t i = 0; i < sec_size; ++i) {
+          sec_tile[i * TILE_WIDTH + l] = y[i];
+        }
+      }
+      else {
+        for(size_t i = 0; i < sec_size; ++i) {
+          sec_tile[i * TILE_WIDTH + l] = T(0);
+        }
+      }
+    }
+  }
+}
+
+//scatters the lanes of a tile back to rows of a row-major batch
+//flags of the rows are recomputed exactly with incremental memory resetting
+template <typename T>
+void deinterleave_rows(
+  const T* Y_tile,
+  const bool* is_nonzero_sec,
+  const size_t* rows,
+  const size_t num_rows,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  T* Y,
+  bool* is_nonzero_row
+) {
+  for(size_t l = 0; l < num_rows; ++l) {
+    T* y = Y + rows[l] * num_neurons;
+    bool* is_nonzero = is_nonzero_row + rows[l] * num_secs;
+    for(size_t s = 0; s < num_secs; ++s) {
+      if(is_nonzero_sec[s]) {
+        const T* sec_tile = Y_tile + s * sec_size * TILE_WIDTH;
+        bool lane_is_nonzero = false;
+        for(size_t i = 0; i < sec_size; ++i) {
+          T v = sec_tile[i * TILE_WIDTH + l];
+          y[s * sec_size + i] = v;
+          lane_is_nonzero |= (v != 0);
+        }
+        is_nonzero[s] = lane_is_nonzero;
+      }
+      else if(is_nonzero[s]) {
+        std::fill(y + s * sec_size, y + (s + 1) * sec_size, T(0));
+        is_nonzero[s] = false;
+      }
+    }
+  }
+}
+
+//tile version of cpu_inference
+//results is a thread-local buffer of sec_size * TILE_WIDTH elements
+//the caller skips tiles without nonzero sections
+//a uniform layer sums the lanes and multiplies by val_w[0] once, as cpu_inference
+template <typename T, typename R>
+void cpu_tile_inference(
+  const T* Y_0,
+  const bool* is_nonzero_sec_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  const int* col_w,
+  const R* row_w,
+  const T* val_w,
+  const bool uniform_w,
+  const typename ValueTraits<T>::acc_type bias,
+  bool* is_nonzero_sec_1,
+  T* Y_1,
+  typename ValueTraits<T>::acc_type* results
+) {
+  using A = typename ValueTraits<T>::acc_type;
+  const A init = uniform_w ? A(0) : bias;
+  const A offset = uniform_w ? bias : A(0);
+  const A scale = uniform_w ? A(val_w[0]) : A(1);
+
+  for(size_t s_o = 0; s_o < num_secs; ++s_o) {
+    //set results to bias directly
+    std::fill(results, results + sec_size * TILE_WIDTH, init);
+
+    const int* sec_col_w = col_w + s_o * num_neurons;
+    const int sec_offset = section_row_offset<R>(s_o, sec_size);
+
+    for(size_t s_i = 0; s_i < num_secs; ++s_i) {
+      if(!is_nonzero_sec_0[s_i]) {
+        continue;
+      }
+      for(size_t j = s_i * sec_size; j < (s_i + 1) * sec_size; ++j) {
+        const T* y = Y_0 + j * TILE_WIDTH;
+        if(std::all_of(y, y + TILE_WIDTH, [](T v){ return v == 0; })) {
+          continue;
+        }
+        for(int k = sec_col_w[j]; k < sec_col_w[j + 1]; ++k) {
+          A* acc = results + (row_w[k] - sec_offset) * TILE_WIDTH;
+          T w = uniform_w ? T(1) : val_w[k];
+          for(size_t l = 0; l < TILE_WIDTH; ++l) {
+            acc[l] += ValueTraits<T>::mul(w, y[l]);
+          }
+        }
+      }
+    }
+
+    bool is_nonzero = false;
+    T* sec_Y_1 = Y_1 + s_o * sec_size * TILE_WIDTH;
+    for(size_t i = 0; i < sec_size * TILE_WIDTH; ++i) {
+      T v = ValueTraits<T>::activate(offset + scale * results[i], s_o * sec_size + i / TILE_WIDTH);
+      sec_Y_1[i] = v;
+      is_nonzero |= (v != 0);
+    }
+    is_nonzero_sec_1[s_o] = is_nonzero;
+  }
+}
+
+//host version of identify on a tile, result_arr receives one category per lane
+//activations are non-negative after ReLU, so a lane is positive iff one value is nonzero
+template <typename T>
+void cpu_identify_tile(
+  const T* Y_tile,
+  const bool* is_nonzero_sec,
+  const size_t num_rows,
+  const size_t sec_size,
+  const size_t num_secs,
+  int* result_arr
+) {
+  std::fill(result_arr, result_arr + num_rows, 0);
+  for(size_t s = 0; s < num_secs; ++s) {
+    if(!is_nonzero_sec[s]) {
+      continue;
+    }
+    const T* sec_tile = Y_tile + s * sec_size * TILE_WIDTH;
+    for(size_t i = 0; i < sec_size; ++i) {
+      for(size_t l = 0; l < num_rows; ++l) {
+        result_arr[l] |= (sec_tile[i * TILE_WIDTH + l] != 0);
+      }
+    }
+  }
+}
+
+}// end of namespace snig ----------------------------------------------
@@ -0,0 +1,288 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <SNIG/utility/fixed_point.hpp>
+#include <SNIG/cpu/active_mask.hpp>
+
+namespace snig{
+
+template <typename R>
+int section_row_offset(const size_t s_o, const size_t sec_size);
+
+template <typename T, typename R>
+void cpu_inference(
+  const T* Y_0,
+  const bool* is_nonzero_row_0,
+  const uint64_t* active_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  const size_t beg_sec,
+  const size_t end_sec,
+  const int* col_w,
+  const R* row_w,
+  const T* val_w,
+  const bool uniform_w,
+  const typename ValueTraits<T>::acc_type bias,
+  bool* is_nonzero_row_1,
+  uint64_t* active_1,
+  T* Y_1,
+  typename ValueTraits<T>::acc_type* results
+);
+
+template <typename T>
+void cpu_pull_inference(
+  const T* Y_0,
+  const bool* is_nonzero_row_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  const size_t beg_sec,
+  const size_t end_sec,
+  const int* row_p,
+  const int* col_p,
+  const T* val_p,
+  const bool uniform_w,
+  const typename ValueTraits<T>::acc_type bias,
+  bool* is_nonzero_row_1,
+  uint64_t* active_1,
+  T* Y_1
+);
+
+template <typename T>
+void cpu_copy_row(
+  const T* Y_0,
+  const bool* is_nonzero_row_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  T* Y_1,
+  bool* is_nonzero_row_1
+);
+
+//-----------------------------------------------------------------------------
+//Definition of kernel function
+//-----------------------------------------------------------------------------
+
+//row indices are either global int or uint16_t relative to the output section s_o
+//returns what to subtract from a stored row index to index the section
+template <typename R>
+int section_row_offset(const size_t s_o, const size_t sec_size) {
+  static_assert(
+    std::is_same<R, int>::value || std::is_same<R, uint16_t>::value,
+    "row index must be either int or uint16_t"
+  );
+  return std::is_same<R, int>::value ? s_o * sec_size : 0;
+}
+
+//host version of snig_inference
+//one call processes one row of Y (blockIdx.x) for all sections (blockIdx.y)
+//Y_0, Y_1, is_nonzero_row_0 and is_nonzero_row_1 point to the beginning of the row
+//results is a thread-local buffer of sec_size elements replacing the shared memory
+//active_0 and active_1 are the block masks of the rows (active_mask.hpp)
+//only output sections [beg_sec, end_sec) are computed, so a weight-stationary schedule
+//can run a block of sections on many rows before the next block,
+//the block mask of Y_1 is cleared by the call computing section 0
+//a uniform layer sums the inputs of each neuron and multiplies by val_w[0] once
+//bias and results are in the unit of the accumulator of T (fixed_point.hpp)
+template <typename T, typename R>
+void cpu_inference(
+  const T* Y_0,
+  const bool* is_nonzero_row_0,
+  const uint64_t* active_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  const size_t beg_sec,
+  const size_t end_sec,
+  const int* col_w,
+  const R* row_w,
+  const T* val_w,
+  const bool uniform_w,
+  const typename ValueTraits<T>::acc_type bias,
+  bool* is_nonzero_row_1,
+  uint64_t* active_1,
+  T* Y_1,
+  typename ValueTraits<T>::acc_type* results
+) {
+  if(is_empty_active_mask(active_0, num_neurons)) {
+    //incremental memory resetting
+    for(size_t s_o = beg_sec; s_o < end_sec; ++s_o) {
+      if(is_nonzero_row_1[s_o]) {
+        std::fill(Y_1 + s_o * sec_size, Y_1 + (s_o + 1) * sec_size, T(0));
+        is_nonzero_row_1[s_o] = false;
+      }
+    }
+    if(beg_sec == 0) {
+      clear_active_mask(active_1, num_neurons);
+    }
+    return;
+  }
+
+  //a uniform layer accumulates from zero and applies bias and value at the end
+  using A = typename ValueTraits<T>::acc_type;
+  const A init = uniform_w ? A(0) : bias;
+  const A offset = uniform_w ? bias : A(0);
+  const A scale = uniform_w ? A(val_w[0]) : A(1);
+  if(beg_sec == 0) {
+    clear_active_mask(active_1, num_neurons);
+  }
+
+  for(size_t s_o = beg_sec; s_o < end_sec; ++s_o) {
+    //set results to bias directly
+    std::fill(results, results + sec_size, init);
+
+    const int* sec_col_w = col_w + s_o * num_neurons;
+    const int sec_offset = section_row_offset<R>(s_o, sec_size);
+
+    for(size_t s_i = 0; s_i < num_secs; ++s_i) {
+      if(!is_nonzero_row_0[s_i]) {
+        continue;
+      }
+      ActiveBlocks blocks(active_0, s_i * sec_size, (s_i + 1) * sec_size);
+      for(size_t beg_j, end_j; blocks.next(beg_j, end_j); ) {
+        for(size_t j = beg_j; j < end_j; ++j) {
+          T valY = Y_0[j];
+          if(valY == 0) {
+            continue;
+          }
+          int beg_w = sec_col_w[j];
+          int end_w = sec_col_w[j + 1];
+          if(uniform_w) {
+            for(int k = beg_w; k < end_w; ++k) {
+              results[row_w[k] - sec_offset] += valY;
+            }
+            continue;
+          }
+          for(int k = beg_w; k < end_w; ++k) {
+            results[row_w[k] - sec_offset] += ValueTraits<T>::mul(valY, val_w[k]);
+          }
+        }
+      }
+    }
+
+    //fused activation and block flags
+    bool is_nonzero = false;
+    T* sec_Y_1 = Y_1 + s_o * sec_size;
+    for(size_t beg = 0, end; beg < sec_size; beg = end) {
+      end = active_block_end(s_o, beg, sec_size);
+      bool is_active = false;
+      for(size_t i = beg; i < end; ++i) {
+        T v = ValueTraits<T>::activate(offset + scale * results[i], s_o * sec_size + i);
+        sec_Y_1[i] = v;
+        is_active |= (v != 0);
+      }
+      if(is_active) {
+        mark_active_block(active_1, s_o * sec_size + beg);
+      }
+      is_nonzero |= is_active;
+    }
+    is_nonzero_row_1[s_o] = is_nonzero;
+  }
+}
+
+//output-stationary version of cpu_inference on the pull layout
+//each output neuron gathers its inputs from the nonzero sections of Y_0
+//and is written exactly once, so no accumulator buffer is needed
+//val_p of a uniform layer holds a single value
+//only the block mask of Y_1 is written, inputs are found through the pull layout
+//output sections are limited to [beg_sec, end_sec) as in cpu_inference
+template <typename T>
+void cpu_pull_inference(
+  const T* Y_0,
+  const bool* is_nonzero_row_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  const size_t beg_sec,
+  const size_t end_sec,
+  const int* row_p,
+  const int* col_p,
+  const T* val_p,
+  const bool uniform_w,
+  const typename ValueTraits<T>::acc_type bias,
+  bool* is_nonzero_row_1,
+  uint64_t* active_1,
+  T* Y_1
+) {
+  bool is_all_zero = true;
+  for(size_t s_i = 0; s_i < num_secs; ++s_i) {
+    is_all_zero &= !is_nonzero_row_0[s_i];
+  }
+
+  if(is_all_zero) {
+    //incremental memory resetting
+    for(size_t s_o = beg_sec; s_o < end_sec; ++s_o) {
+      if(is_nonzero_row_1[s_o]) {
+        std::fill(Y_1 + s_o * sec_size, Y_1 + (s_o + 1) * sec_size, T(0));
+        is_nonzero_row_1[s_o] = false;
+      }
+    }
+    if(beg_sec == 0) {
+      clear_active_mask(active_1, num_neurons);
+    }
+    return;
+  }
+
+  using A = typename ValueTraits<T>::acc_type;
+  const A init = uniform_w ? A(0) : bias;
+  const A offset = uniform_w ? bias : A(0);
+  const A scale = uniform_w ? A(val_p[0]) : A(1);
+  if(beg_sec == 0) {
+    clear_active_mask(active_1, num_neurons);
+  }
+
+  for(size_t s_o = beg_sec; s_o < end_sec; ++s_o) {
+    bool is_nonzero = false;
+    for(size_t i = s_o * sec_size; i < (s_o + 1) * sec_size; ++i) {
+      const int* key_p = row_p + i * num_secs;
+      A sum = init;
+      for(size_t s_i = 0; s_i < num_secs; ++s_i) {
+        if(!is_nonzero_row_0[s_i]) {
+          continue;
+        }
+        if(uniform_w) {
+          for(int k = key_p[s_i]; k < key_p[s_i + 1]; ++k) {
+            sum += Y_0[col_p[k]];
+          }
+          continue;
+        }
+        for(int k = key_p[s_i]; k < key_p[s_i + 1]; ++k) {
+          sum += ValueTraits<T>::mul(Y_0[col_p[k]], val_p[k]);
+        }
+      }
+      T v = ValueTraits<T>::activate(offset + scale * sum, i);
+      Y_1[i] = v;
+      if(v != 0) {
+        mark_active_block(active_1, i);
+        is_nonzero = true;
+      }
+    }
+    is_nonzero_row_1[s_o] = is_nonzero;
+  }
+}
+
+//copies one row of Y into another row with incremental memory resetting
+//only nonzero sections of the source are copied, stale sections of the target are reset
+template <typename T>
+void cpu_copy_row(
+  const T* Y_0,
+  const bool* is_nonzero_row_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  T* Y_1,
+  bool* is_nonzero_row_1
+) {
+  for(size_t s = 0; s < num_secs; ++s) {
+    if(is_nonzero_row_0[s]) {
+      std::copy(Y_0 + s * sec_size, Y_0 + (s + 1) * sec_size, Y_1 + s * sec_size);
+      is_nonzero_row_1[s] = true;
+    }
+    else if(is_nonzero_row_1[s]) {
+      std::fill(Y_1 + s * sec_size, Y_1 + (s + 1) * sec_size, T(0));
+      is_nonzero_row_1[s] = false;
+    }
+  }
+}
+
+}// end of namespace snig ----------------------------------------------
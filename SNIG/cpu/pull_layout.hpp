@@ -0,0 +1,140 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <SNIG/cpu/kernel.hpp>
+
+namespace snig{
+
+//Weight layouts of the CPU engine
+//PUSH is the packed CSC of the binary files: each active input neuron adds
+//its column into the accumulators of an output section.
+//PULL is a CSR by output neuron: each output neuron gathers its inputs
+//and is written exactly once, without accumulators or write conflicts.
+//AUTO times both layouts on the first batches and keeps the faster one per layer.
+
+enum class WeightLayout {
+  AUTO,
+  PUSH,
+  PULL
+};
+
+template <typename T>
+struct PullLayer {
+
+  //entries of output neuron i coming from input section s_i are
+  //[row_p[i * num_secs + s_i], row_p[i * num_secs + s_i + 1])
+  //entries of one output neuron are contiguous and sorted by input neuron
+  std::vector<int> row_p;
+  std::vector<int> col_p;
+  std::vector<T> val_p;
+};
+
+inline
+WeightLayout to_weight_layout(const std::string& name);
+
+inline
+const char* weight_layout_name(const WeightLayout layout);
+
+template <typename T, typename R>
+void build_pull_layer(
+  const int* col_w,
+  const R* row_w,
+  const T* val_w,
+  const bool uniform_w,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  PullLayer<T>& layer
+);
+
+//-----------------------------------------------------------------------------
+//Definition of pull layout function
+//-----------------------------------------------------------------------------
+
+inline
+WeightLayout to_weight_layout(const std::string& name) {
+  if(name == "auto") {
+    return WeightLayout::AUTO;
+  }
+  if(name == "push") {
+    return WeightLayout::PUSH;
+  }
+  if(name == "pull") {
+    return WeightLayout::PULL;
+  }
+  throw std::runtime_error("weight layout must be either auto, push, or pull");
+}
+
+inline
+const char* weight_layout_name(const WeightLayout layout) {
+  switch(layout) {
+    case WeightLayout::PUSH:
+      return "push";
+    case WeightLayout::PULL:
+      return "pull";
+    default:
+      return "auto";
+  }
+}
+
+//transposes one packed CSC layer by counting sort
+//col_w has num_neurons * num_secs + 1 offsets indexed by s_o * num_neurons + j
+//a uniform layer keeps its single value
+//row_w is either global int or uint16_t relative to the output section
+template <typename T, typename R>
+void build_pull_layer(
+  const int* col_w,
+  const R* row_w,
+  const T* val_w,
+  const bool uniform_w,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  PullLayer<T>& layer
+) {
+  const size_t num_keys = num_neurons * num_secs;
+  const int nnz = col_w[num_keys];
+
+  layer.row_p.assign(num_keys + 1, 0);
+  layer.col_p.resize(nnz);
+  layer.val_p.resize(uniform_w ? 1 : nnz);
+  if(uniform_w) {
+    layer.val_p[0] = val_w[0];
+  }
+
+  //count entries per (output neuron, input section)
+  for(size_t s_o = 0; s_o < num_secs; ++s_o) {
+    const int* sec_col_w = col_w + s_o * num_neurons;
+    const int row_base = s_o * sec_size - section_row_offset<R>(s_o, sec_size);
+    for(size_t j = 0; j < num_neurons; ++j) {
+      size_t s_i = j / sec_size;
+      for(int k = sec_col_w[j]; k < sec_col_w[j + 1]; ++k) {
+        ++layer.row_p[(row_base + row_w[k]) * num_secs + s_i + 1];
+      }
+    }
+  }
+  for(size_t key = 0; key < num_keys; ++key) {
+    layer.row_p[key + 1] += layer.row_p[key];
+  }
+
+  //input neurons are visited in increasing order within every key
+  std::vector<int> pos(layer.row_p.begin(), layer.row_p.end() - 1);
+  for(size_t j = 0; j < num_neurons; ++j) {
+    size_t s_i = j / sec_size;
+    for(size_t s_o = 0; s_o < num_secs; ++s_o) {
+      const int* sec_col_w = col_w + s_o * num_neurons;
+      const int row_base = s_o * sec_size - section_row_offset<R>(s_o, sec_size);
+      for(int k = sec_col_w[j]; k < sec_col_w[j + 1]; ++k) {
+        int p = pos[(row_base + row_w[k]) * num_secs + s_i]++;
+        layer.col_p[p] = j;
+        if(!uniform_w) {
+          layer.val_p[p] = val_w[k];
+        }
+      }
+    }
+  }
+}
+
+}// end of namespace snig ----------------------------------------------
@@ -0,0 +1,925 @@
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <SNIG/cpu/kernel.hpp>
+#include <SNIG/cpu/interleave.hpp>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define SNIG_ENABLE_X86_SIMD
+#endif
+
+namespace snig{
+
+//SIMD versions of cpu_inference selected at runtime by CPUID
+//Each kernel is compiled for its own instruction set through target attributes,
+//so the binary runs on any x86-64 machine regardless of -march.
+//All kernels keep the contract of snig_inference: Y_1 = min(32, max(0, bias + Y_0 * W)).
+//A uniform layer is computed as bias + val_w[0] * (Y_0 * 1) without loading values.
+//Push kernels skip zero blocks of the input row by its block mask (active_mask.hpp).
+//Push kernels are implemented for float, half, and fixed point int16_t (AVX2 only),
+//tile kernels for float, half, and fixed point int16_t.
+//half values are converted to float in registers with F16C, which every CPU with AVX2 supports.
+
+enum class CPUKernel {
+  SCALAR,
+  AVX2,
+  AVX512
+};
+
+inline
+CPUKernel detect_cpu_kernel();
+
+inline
+const char* cpu_kernel_name(const CPUKernel kernel);
+
+template <typename T, typename R>
+void cpu_inference_dispatch(
+  const CPUKernel kernel,
+  const T* Y_0,
+  const bool* is_nonzero_row_0,
+  const uint64_t* active_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  const size_t beg_sec,
+  const size_t end_sec,
+  const int* col_w,
+  const R* row_w,
+  const T* val_w,
+  const bool uniform_w,
+  const typename ValueTraits<T>::acc_type bias,
+  bool* is_nonzero_row_1,
+  uint64_t* active_1,
+  T* Y_1,
+  typename ValueTraits<T>::acc_type* results
+);
+
+template <typename T, typename R>
+void cpu_tile_inference_dispatch(
+  const CPUKernel kernel,
+  const T* Y_0,
+  const bool* is_nonzero_sec_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  const int* col_w,
+  const R* row_w,
+  const T* val_w,
+  const bool uniform_w,
+  const typename ValueTraits<T>::acc_type bias,
+  bool* is_nonzero_sec_1,
+  T* Y_1,
+  typename ValueTraits<T>::acc_type* results
+);
+
+//-----------------------------------------------------------------------------
+//Definition of simd kernel function
+//-----------------------------------------------------------------------------
+
+inline
+CPUKernel detect_cpu_kernel() {
+#ifdef SNIG_ENABLE_X86_SIMD
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f")) {
+    return CPUKernel::AVX512;
+  }
+  if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return CPUKernel::AVX2;
+  }
+#endif
+  return CPUKernel::SCALAR;
+}
+
+inline
+const char* cpu_kernel_name(const CPUKernel kernel) {
+  switch(kernel) {
+    case CPUKernel::AVX512:
+      return "AVX-512";
+    case CPUKernel::AVX2:
+      return "AVX2";
+    default:
+      return "scalar";
+  }
+}
+
+//the input row is all zero, so the output row is all zero
+//returns false if there is work to do
+template <typename T>
+bool cpu_reset_empty_row(
+  const uint64_t* active_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t beg_sec,
+  const size_t end_sec,
+  bool* is_nonzero_row_1,
+  uint64_t* active_1,
+  T* Y_1
+) {
+  if(!is_empty_active_mask(active_0, sec_size * num_secs)) {
+    return false;
+  }
+
+  //incremental memory resetting
+  for(size_t s_o = beg_sec; s_o < end_sec; ++s_o) {
+    if(is_nonzero_row_1[s_o]) {
+      std::fill(Y_1 + s_o * sec_size, Y_1 + (s_o + 1) * sec_size, T(0));
+      is_nonzero_row_1[s_o] = false;
+    }
+  }
+  if(beg_sec == 0) {
+    clear_active_mask(active_1, sec_size * num_secs);
+  }
+  return true;
+}
+
+#ifdef SNIG_ENABLE_X86_SIMD
+
+//GCC implements the unmasked AVX-512 gathers and conversions on _mm512_undefined_*
+//sources, which -Wmaybe-uninitialized reports once per instantiation of a kernel
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+//loads and stores of 8 or 16 values, half is converted from and to float in registers
+__attribute__((target("f16c")))
+inline
+float cpu_to_float(const float v) {
+  return v;
+}
+
+__attribute__((target("f16c")))
+inline
+float cpu_to_float(const half v) {
+  return _cvtsh_ss(v.bits);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+inline
+__m256 cpu_load_ps_avx2(const float* p) {
+  return _mm256_loadu_ps(p);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+inline
+__m256 cpu_load_ps_avx2(const half* p) {
+  return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)p));
+}
+
+__attribute__((target("avx2,fma,f16c")))
+inline
+void cpu_store_ps_avx2(float* p, const __m256 v) {
+  _mm256_storeu_ps(p, v);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+inline
+void cpu_store_ps_avx2(half* p, const __m256 v) {
+  _mm_storeu_si128((__m128i*)p, _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+}
+
+__attribute__((target("avx512f,f16c")))
+inline
+__m512 cpu_load_ps_avx512(const float* p) {
+  return _mm512_loadu_ps(p);
+}
+
+__attribute__((target("avx512f,f16c")))
+inline
+__m512 cpu_load_ps_avx512(const half* p) {
+  return _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)p));
+}
+
+//the first count of 16 values with zeros in the other lanes
+__attribute__((target("avx512f,f16c")))
+inline
+__m512 cpu_load_ps_avx512(const float* p, const int count) {
+  return _mm512_maskz_loadu_ps(static_cast<__mmask16>((1u << count) - 1), p);
+}
+
+//masked 16-bit loads need AVX512BW, the tail is copied instead
+__attribute__((target("avx512f,f16c")))
+inline
+__m512 cpu_load_ps_avx512(const half* p, const int count) {
+  alignas(32) uint16_t values[16] = {};
+  std::memcpy(values, p, sizeof(half) * count);
+  return _mm512_cvtph_ps(_mm256_load_si256((const __m256i*)values));
+}
+
+__attribute__((target("avx512f,f16c")))
+inline
+void cpu_store_ps_avx512(float* p, const __m512 v) {
+  _mm512_storeu_ps(p, v);
+}
+
+__attribute__((target("avx512f,f16c")))
+inline
+void cpu_store_ps_avx512(half* p, const __m512 v) {
+  _mm256_storeu_si256((__m256i*)p, _mm512_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+}
+
+//AVX2 has no scatter
+//products of a column block are computed with SIMD and added back with scalar stores
+//rows of a column are distinct, so the order of the additions does not matter
+template <typename T, typename R>
+__attribute__((target("avx2,fma,f16c")))
+void cpu_inference_avx2(
+  const T* Y_0,
+  const bool* is_nonzero_row_0,
+  const uint64_t* active_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  const size_t beg_sec,
+  const size_t end_sec,
+  const int* col_w,
+  const R* row_w,
+  const T* val_w,
+  const bool uniform_w,
+  const float bias,
+  bool* is_nonzero_row_1,
+  uint64_t* active_1,
+  T* Y_1,
+  float* results
+) {
+  if(cpu_reset_empty_row(active_0, sec_size, num_secs, beg_sec, end_sec, is_nonzero_row_1, active_1, Y_1)) {
+    return;
+  }
+  if(beg_sec == 0) {
+    clear_active_mask(active_1, num_neurons);
+  }
+
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 upper = _mm256_set1_ps(32.f);
+  const float offset = uniform_w ? bias : 0.f;
+  const float scale = uniform_w ? cpu_to_float(val_w[0]) : 1.f;
+  const __m256 init_v = _mm256_set1_ps(uniform_w ? 0.f : bias);
+  const __m256 offset_v = _mm256_set1_ps(offset);
+  const __m256 scale_v = _mm256_set1_ps(scale);
+  alignas(32) float products[8];
+
+  for(size_t s_o = beg_sec; s_o < end_sec; ++s_o) {
+    //set results to bias directly
+    size_t i = 0;
+    for(; i + 8 <= sec_size; i += 8) {
+      _mm256_storeu_ps(results + i, init_v);
+    }
+    for(; i < sec_size; ++i) {
+      results[i] = uniform_w ? 0.f : bias;
+    }
+
+    const int* sec_col_w = col_w + s_o * num_neurons;
+    float* sec_results = results - section_row_offset<R>(s_o, sec_size);
+
+    for(size_t s_i = 0; s_i < num_secs; ++s_i) {
+      if(!is_nonzero_row_0[s_i]) {
+        continue;
+      }
+      ActiveBlocks blocks(active_0, s_i * sec_size, (s_i + 1) * sec_size);
+      for(size_t beg_j, end_j; blocks.next(beg_j, end_j); ) {
+        for(size_t j = beg_j; j < end_j; ++j) {
+          float valY = cpu_to_float(Y_0[j]);
+          if(valY == 0) {
+            continue;
+          }
+          const __m256 valY_v = _mm256_set1_ps(valY);
+          int k = sec_col_w[j];
+          int end_w = sec_col_w[j + 1];
+          for(; k + 8 <= end_w; k += 8) {
+            _mm256_store_ps(products, uniform_w ? valY_v : _mm256_mul_ps(valY_v, cpu_load_ps_avx2(val_w + k)));
+            const R* rows = row_w + k;
+            sec_results[rows[0]] += products[0];
+            sec_results[rows[1]] += products[1];
+            sec_results[rows[2]] += products[2];
+            sec_results[rows[3]] += products[3];
+            sec_results[rows[4]] += products[4];
+            sec_results[rows[5]] += products[5];
+            sec_results[rows[6]] += products[6];
+            sec_results[rows[7]] += products[7];
+          }
+          for(; k < end_w; ++k) {
+            sec_results[row_w[k]] += uniform_w ? valY : valY * cpu_to_float(val_w[k]);
+          }
+        }
+      }
+    }
+
+    //fused clamp, nonzero test and block flags
+    T* sec_Y_1 = Y_1 + s_o * sec_size;
+    bool is_nonzero = false;
+    for(size_t beg = 0, end; beg < sec_size; beg = end) {
+      end = active_block_end(s_o, beg, sec_size);
+      __m256 any = zero;
+      i = beg;
+      for(; i + 8 <= end; i += 8) {
+        __m256 v = _mm256_fmadd_ps(scale_v, _mm256_loadu_ps(results + i), offset_v);
+        v = _mm256_min_ps(upper, _mm256_max_ps(v, zero));
+        cpu_store_ps_avx2(sec_Y_1 + i, v);
+        any = _mm256_or_ps(any, _mm256_cmp_ps(v, zero, _CMP_NEQ_OQ));
+      }
+      bool is_active = _mm256_movemask_ps(any) != 0;
+      for(; i < end; ++i) {
+        T v = T(std::min(32.f, std::max(offset + scale * results[i], 0.f)));
+        sec_Y_1[i] = v;
+        is_active |= (v != 0);
+      }
+      if(is_active) {
+        mark_active_block(active_1, s_o * sec_size + beg);
+      }
+      is_nonzero |= is_active;
+    }
+    is_nonzero_row_1[s_o] = is_nonzero;
+  }
+}
+
+//fixed point version of cpu_inference_avx2 (Q5.10 activations, Q8.7 weights)
+//valY is broadcast as (y, 0) pairs of int16_t and the weights are sign extended into (w, sign) pairs,
+//so one multiply-add of the pairs gives 8 exact int32_t products y * w
+//the epilogue adds the rounding offsets of 8 neurons, shifts, clamps and packs them back to int16_t
+template <typename R>
+__attribute__((target("avx2")))
+void cpu_inference_avx2_fixed(
+  const int16_t* Y_0,
+  const bool* is_nonzero_row_0,
+  const uint64_t* active_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  const size_t beg_sec,
+  const size_t end_sec,
+  const int* col_w,
+  const R* row_w,
+  const int16_t* val_w,
+  const bool uniform_w,
+  const int32_t bias,
+  bool* is_nonzero_row_1,
+  uint64_t* active_1,
+  int16_t* Y_1,
+  int32_t* results
+) {
+  if(cpu_reset_empty_row(active_0, sec_size, num_secs, beg_sec, end_sec, is_nonzero_row_1, active_1, Y_1)) {
+    return;
+  }
+  if(beg_sec == 0) {
+    clear_active_mask(active_1, num_neurons);
+  }
+
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i upper = _mm256_set1_epi32(FIXED_ACTIVATION_MAX);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i hash = _mm256_set1_epi32(static_cast<int>(2654435761u));
+  const int32_t offset = uniform_w ? bias : 0;
+  const int32_t scale = uniform_w ? val_w[0] : 1;
+  const __m256i init_v = _mm256_set1_epi32(uniform_w ? 0 : bias);
+  const __m256i offset_v = _mm256_set1_epi32(offset);
+  const __m256i scale_v = _mm256_set1_epi32(scale);
+  alignas(32) int32_t products[8];
+
+  for(size_t s_o = beg_sec; s_o < end_sec; ++s_o) {
+    //set results to bias directly
+    size_t i = 0;
+    for(; i + 8 <= sec_size; i += 8) {
+      _mm256_storeu_si256((__m256i*)(results + i), init_v);
+    }
+    for(; i < sec_size; ++i) {
+      results[i] = uniform_w ? 0 : bias;
+    }
+
+    const int* sec_col_w = col_w + s_o * num_neurons;
+    int32_t* sec_results = results - section_row_offset<R>(s_o, sec_size);
+
+    for(size_t s_i = 0; s_i < num_secs; ++s_i) {
+      if(!is_nonzero_row_0[s_i]) {
+        continue;
+      }
+      ActiveBlocks blocks(active_0, s_i * sec_size, (s_i + 1) * sec_size);
+      for(size_t beg_j, end_j; blocks.next(beg_j, end_j); ) {
+        for(size_t j = beg_j; j < end_j; ++j) {
+          int32_t valY = Y_0[j];
+          if(valY == 0) {
+            continue;
+          }
+          const __m256i valY_v = _mm256_set1_epi32(valY);
+          int k = sec_col_w[j];
+          int end_w = sec_col_w[j + 1];
+          for(; k + 8 <= end_w; k += 8) {
+            _mm256_store_si256(
+              (__m256i*)products,
+              uniform_w ? valY_v : _mm256_madd_epi16(valY_v, _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(val_w + k))))
+            );
+            const R* rows = row_w + k;
+            sec_results[rows[0]] += products[0];
+            sec_results[rows[1]] += products[1];
+            sec_results[rows[2]] += products[2];
+            sec_results[rows[3]] += products[3];
+            sec_results[rows[4]] += products[4];
+            sec_results[rows[5]] += products[5];
+            sec_results[rows[6]] += products[6];
+            sec_results[rows[7]] += products[7];
+          }
+          for(; k < end_w; ++k) {
+            sec_results[row_w[k]] += uniform_w ? valY : valY * val_w[k];
+          }
+        }
+      }
+    }
+
+    //fused rounding, clamp, nonzero test and block flags
+    int16_t* sec_Y_1 = Y_1 + s_o * sec_size;
+    bool is_nonzero = false;
+    for(size_t beg = 0, end; beg < sec_size; beg = end) {
+      end = active_block_end(s_o, beg, sec_size);
+      __m256i any = zero;
+      i = beg;
+      for(; i + 8 <= end; i += 8) {
+        //same offsets as ValueTraits<int16_t>::rounding
+        const __m256i neurons = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(s_o * sec_size + i)), lanes);
+        const __m256i rounding = _mm256_srli_epi32(_mm256_mullo_epi32(neurons, hash), 32 - FIXED_FRAC_BITS);
+        __m256i v = _mm256_add_epi32(offset_v, _mm256_mullo_epi32(scale_v, _mm256_loadu_si256((const __m256i*)(results + i))));
+        v = _mm256_srai_epi32(_mm256_add_epi32(v, rounding), FIXED_FRAC_BITS);
+        v = _mm256_min_epi32(upper, _mm256_max_epi32(v, zero));
+        _mm_storeu_si128((__m128i*)(sec_Y_1 + i), _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+        any = _mm256_or_si256(any, v);
+      }
+      bool is_active = !_mm256_testz_si256(any, any);
+      for(; i < end; ++i) {
+        int16_t v = ValueTraits<int16_t>::activate(offset + scale * results[i], s_o * sec_size + i);
+        sec_Y_1[i] = v;
+        is_active |= (v != 0);
+      }
+      if(is_active) {
+        mark_active_block(active_1, s_o * sec_size + beg);
+      }
+      is_nonzero |= is_active;
+    }
+    is_nonzero_row_1[s_o] = is_nonzero;
+  }
+}
+
+//loads 16 row indices, or the first count of them with zeros in the other lanes
+__attribute__((target("avx512f")))
+inline
+__m512i cpu_load_rows_avx512(const int* row_w) {
+  return _mm512_loadu_si512(row_w);
+}
+
+__attribute__((target("avx512f")))
+inline
+__m512i cpu_load_rows_avx512(const int* row_w, const int count) {
+  return _mm512_maskz_loadu_epi32(static_cast<__mmask16>((1u << count) - 1), row_w);
+}
+
+//uint16_t indices are widened in registers, so a column costs 32 bytes of index instead of 64
+__attribute__((target("avx512f")))
+inline
+__m512i cpu_load_rows_avx512(const uint16_t* row_w) {
+  return _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)row_w));
+}
+
+//masked 16-bit loads need AVX512BW, the tail is copied instead
+__attribute__((target("avx512f")))
+inline
+__m512i cpu_load_rows_avx512(const uint16_t* row_w, const int count) {
+  alignas(32) uint16_t rows[16] = {};
+  std::copy(row_w, row_w + count, rows);
+  return _mm512_cvtepu16_epi32(_mm256_load_si256((const __m256i*)rows));
+}
+
+//AVX-512 gathers the accumulators of 16 rows of a column, adds the products and scatters them back
+//rows of a column are distinct, so lanes never conflict
+template <typename T, typename R>
+__attribute__((target("avx512f,f16c")))
+void cpu_inference_avx512(
+  const T* Y_0,
+  const bool* is_nonzero_row_0,
+  const uint64_t* active_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  const size_t beg_sec,
+  const size_t end_sec,
+  const int* col_w,
+  const R* row_w,
+  const T* val_w,
+  const bool uniform_w,
+  const float bias,
+  bool* is_nonzero_row_1,
+  uint64_t* active_1,
+  T* Y_1,
+  float* results
+) {
+  if(cpu_reset_empty_row(active_0, sec_size, num_secs, beg_sec, end_sec, is_nonzero_row_1, active_1, Y_1)) {
+    return;
+  }
+  if(beg_sec == 0) {
+    clear_active_mask(active_1, num_neurons);
+  }
+
+  const __m512 zero = _mm512_setzero_ps();
+  const __m512 upper = _mm512_set1_ps(32.f);
+  const float offset = uniform_w ? bias : 0.f;
+  const float scale = uniform_w ? cpu_to_float(val_w[0]) : 1.f;
+  const __m512 init_v = _mm512_set1_ps(uniform_w ? 0.f : bias);
+  const __m512 offset_v = _mm512_set1_ps(offset);
+  const __m512 scale_v = _mm512_set1_ps(scale);
+
+  for(size_t s_o = beg_sec; s_o < end_sec; ++s_o) {
+    //set results to bias directly
+    size_t i = 0;
+    for(; i + 16 <= sec_size; i += 16) {
+      _mm512_storeu_ps(results + i, init_v);
+    }
+    for(; i < sec_size; ++i) {
+      results[i] = uniform_w ? 0.f : bias;
+    }
+
+    const int* sec_col_w = col_w + s_o * num_neurons;
+    const __m512i sec_offset = _mm512_set1_epi32(section_row_offset<R>(s_o, sec_size));
+
+    for(size_t s_i = 0; s_i < num_secs; ++s_i) {
+      if(!is_nonzero_row_0[s_i]) {
+        continue;
+      }
+      ActiveBlocks blocks(active_0, s_i * sec_size, (s_i + 1) * sec_size);
+      for(size_t beg_j, end_j; blocks.next(beg_j, end_j); ) {
+        for(size_t j = beg_j; j < end_j; ++j) {
+          float valY = cpu_to_float(Y_0[j]);
+          if(valY == 0) {
+            continue;
+          }
+          const __m512 valY_v = _mm512_set1_ps(valY);
+          int k = sec_col_w[j];
+          int end_w = sec_col_w[j + 1];
+          for(; k + 16 <= end_w; k += 16) {
+            __m512i idx = _mm512_sub_epi32(cpu_load_rows_avx512(row_w + k), sec_offset);
+            __m512 acc = _mm512_i32gather_ps(idx, results, 4);
+            acc = uniform_w ? _mm512_add_ps(valY_v, acc) : _mm512_fmadd_ps(valY_v, cpu_load_ps_avx512(val_w + k), acc);
+            _mm512_i32scatter_ps(results, idx, acc, 4);
+          }
+          if(k < end_w) {
+            __mmask16 mask = static_cast<__mmask16>((1u << (end_w - k)) - 1);
+            __m512i idx = _mm512_sub_epi32(cpu_load_rows_avx512(row_w + k, end_w - k), sec_offset);
+            __m512 acc = _mm512_mask_i32gather_ps(zero, mask, idx, results, 4);
+            acc = uniform_w ? _mm512_add_ps(valY_v, acc) : _mm512_fmadd_ps(valY_v, cpu_load_ps_avx512(val_w + k, end_w - k), acc);
+            _mm512_mask_i32scatter_ps(results, mask, idx, acc, 4);
+          }
+        }
+      }
+    }
+
+    //fused clamp, nonzero test and block flags
+    T* sec_Y_1 = Y_1 + s_o * sec_size;
+    bool is_nonzero = false;
+    for(size_t beg = 0, end; beg < sec_size; beg = end) {
+      end = active_block_end(s_o, beg, sec_size);
+      __mmask16 any = 0;
+      i = beg;
+      for(; i + 16 <= end; i += 16) {
+        __m512 v = _mm512_fmadd_ps(scale_v, _mm512_loadu_ps(results + i), offset_v);
+        v = _mm512_min_ps(upper, _mm512_max_ps(v, zero));
+        cpu_store_ps_avx512(sec_Y_1 + i, v);
+        any |= _mm512_cmp_ps_mask(v, zero, _CMP_NEQ_OQ);
+      }
+      bool is_active = any != 0;
+      for(; i < end; ++i) {
+        T v = T(std::min(32.f, std::max(offset + scale * results[i], 0.f)));
+        sec_Y_1[i] = v;
+        is_active |= (v != 0);
+      }
+      if(is_active) {
+        mark_active_block(active_1, s_o * sec_size + beg);
+      }
+      is_nonzero |= is_active;
+    }
+    is_nonzero_row_1[s_o] = is_nonzero;
+  }
+}
+
+static_assert(TILE_WIDTH == 16, "tile kernels assume 16 lanes");
+
+//one input neuron of a tile is one vector of 16 lanes
+//each weight nonzero is a broadcast multiply-add into the accumulators of its output neuron
+template <typename T, typename R>
+__attribute__((target("avx512f,f16c")))
+void cpu_tile_inference_avx512(
+  const T* Y_0,
+  const bool* is_nonzero_sec_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  const int* col_w,
+  const R* row_w,
+  const T* val_w,
+  const bool uniform_w,
+  const float bias,
+  bool* is_nonzero_sec_1,
+  T* Y_1,
+  float* results
+) {
+  const __m512 zero = _mm512_setzero_ps();
+  const __m512 upper = _mm512_set1_ps(32.f);
+  const float offset = uniform_w ? bias : 0.f;
+  const float scale = uniform_w ? cpu_to_float(val_w[0]) : 1.f;
+  const __m512 init_v = _mm512_set1_ps(uniform_w ? 0.f : bias);
+  const __m512 offset_v = _mm512_set1_ps(offset);
+  const __m512 scale_v = _mm512_set1_ps(scale);
+
+  for(size_t s_o = 0; s_o < num_secs; ++s_o) {
+    //set results to bias directly
+    for(size_t i = 0; i < sec_size; ++i) {
+      _mm512_storeu_ps(results + i * 16, init_v);
+    }
+
+    const int* sec_col_w = col_w + s_o * num_neurons;
+    float* sec_results = results - section_row_offset<R>(s_o, sec_size) * 16;
+
+    for(size_t s_i = 0; s_i < num_secs; ++s_i) {
+      if(!is_nonzero_sec_0[s_i]) {
+        continue;
+      }
+      for(size_t j = s_i * sec_size; j < (s_i + 1) * sec_size; ++j) {
+        const __m512 y = cpu_load_ps_avx512(Y_0 + j * 16);
+        if(_mm512_cmp_ps_mask(y, zero, _CMP_NEQ_OQ) == 0) {
+          continue;
+        }
+        for(int k = sec_col_w[j]; k < sec_col_w[j + 1]; ++k) {
+          float* acc = sec_results + row_w[k] * 16;
+          __m512 sum = uniform_w ? _mm512_add_ps(y, _mm512_loadu_ps(acc)) : _mm512_fmadd_ps(_mm512_set1_ps(cpu_to_float(val_w[k])), y, _mm512_loadu_ps(acc));
+          _mm512_storeu_ps(acc, sum);
+        }
+      }
+    }
+
+    //fused clamp and nonzero test
+    T* sec_Y_1 = Y_1 + s_o * sec_size * 16;
+    __mmask16 any = 0;
+    for(size_t i = 0; i < sec_size; ++i) {
+      __m512 v = _mm512_fmadd_ps(scale_v, _mm512_loadu_ps(results + i * 16), offset_v);
+      v = _mm512_min_ps(upper, _mm512_max_ps(v, zero));
+      cpu_store_ps_avx512(sec_Y_1 + i * 16, v);
+      any |= _mm512_cmp_ps_mask(v, zero, _CMP_NEQ_OQ);
+    }
+    is_nonzero_sec_1[s_o] = any != 0;
+  }
+}
+
+//AVX2 covers the 16 lanes of a tile with two vectors
+template <typename T, typename R>
+__attribute__((target("avx2,fma,f16c")))
+void cpu_tile_inference_avx2(
+  const T* Y_0,
+  const bool* is_nonzero_sec_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  const int* col_w,
+  const R* row_w,
+  const T* val_w,
+  const bool uniform_w,
+  const float bias,
+  bool* is_nonzero_sec_1,
+  T* Y_1,
+  float* results
+) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 upper = _mm256_set1_ps(32.f);
+  const float offset = uniform_w ? bias : 0.f;
+  const float scale = uniform_w ? cpu_to_float(val_w[0]) : 1.f;
+  const __m256 init_v = _mm256_set1_ps(uniform_w ? 0.f : bias);
+  const __m256 offset_v = _mm256_set1_ps(offset);
+  const __m256 scale_v = _mm256_set1_ps(scale);
+
+  for(size_t s_o = 0; s_o < num_secs; ++s_o) {
+    //set results to bias directly
+    for(size_t i = 0; i < sec_size * 2; ++i) {
+      _mm256_storeu_ps(results + i * 8, init_v);
+    }
+
+    const int* sec_col_w = col_w + s_o * num_neurons;
+    float* sec_results = results - section_row_offset<R>(s_o, sec_size) * 16;
+
+    for(size_t s_i = 0; s_i < num_secs; ++s_i) {
+      if(!is_nonzero_sec_0[s_i]) {
+        continue;
+      }
+      for(size_t j = s_i * sec_size; j < (s_i + 1) * sec_size; ++j) {
+        const __m256 y_lo = cpu_load_ps_avx2(Y_0 + j * 16);
+        const __m256 y_hi = cpu_load_ps_avx2(Y_0 + j * 16 + 8);
+        __m256 nonzero = _mm256_or_ps(_mm256_cmp_ps(y_lo, zero, _CMP_NEQ_OQ), _mm256_cmp_ps(y_hi, zero, _CMP_NEQ_OQ));
+        if(_mm256_movemask_ps(nonzero) == 0) {
+          continue;
+        }
+        for(int k = sec_col_w[j]; k < sec_col_w[j + 1]; ++k) {
+          float* acc = sec_results + row_w[k] * 16;
+          const __m256 w = _mm256_set1_ps(uniform_w ? 1.f : cpu_to_float(val_w[k]));
+          _mm256_storeu_ps(acc, _mm256_fmadd_ps(w, y_lo, _mm256_loadu_ps(acc)));
+          _mm256_storeu_ps(acc + 8, _mm256_fmadd_ps(w, y_hi, _mm256_loadu_ps(acc + 8)));
+        }
+      }
+    }
+
+    //fused clamp and nonzero test
+    T* sec_Y_1 = Y_1 + s_o * sec_size * 16;
+    __m256 any = zero;
+    for(size_t i = 0; i < sec_size * 2; ++i) {
+      __m256 v = _mm256_fmadd_ps(scale_v, _mm256_loadu_ps(results + i * 8), offset_v);
+      v = _mm256_min_ps(upper, _mm256_max_ps(v, zero));
+      cpu_store_ps_avx2(sec_Y_1 + i * 8, v);
+      any = _mm256_or_ps(any, _mm256_cmp_ps(v, zero, _CMP_NEQ_OQ));
+    }
+    is_nonzero_sec_1[s_o] = _mm256_movemask_ps(any) != 0;
+  }
+}
+
+//fixed point version of cpu_tile_inference_avx2 (Q5.10 activations, Q8.7 weights)
+//the 16 lanes of an input neuron are a single vector of int16_t
+//activations are non-negative, so zero extension widens them into (y, 0) pairs of int16_t,
+//and each nonzero is one multiply-add of the pairs with (w, 0) into int32_t accumulators
+template <typename R>
+__attribute__((target("avx2")))
+void cpu_tile_inference_avx2_fixed(
+  const int16_t* Y_0,
+  const bool* is_nonzero_sec_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  const int* col_w,
+  const R* row_w,
+  const int16_t* val_w,
+  const bool uniform_w,
+  const int32_t bias,
+  bool* is_nonzero_sec_1,
+  int16_t* Y_1,
+  int32_t* results
+) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i upper = _mm256_set1_epi32(FIXED_ACTIVATION_MAX);
+  const __m256i init_v = _mm256_set1_epi32(uniform_w ? 0 : bias);
+  const __m256i offset_v = _mm256_set1_epi32(uniform_w ? bias : 0);
+  const __m256i scale_v = _mm256_set1_epi32(uniform_w ? val_w[0] : 1);
+
+  for(size_t s_o = 0; s_o < num_secs; ++s_o) {
+    //set results to bias directly
+    for(size_t i = 0; i < sec_size * 2; ++i) {
+      _mm256_storeu_si256((__m256i*)(results + i * 8), init_v);
+    }
+
+    const int* sec_col_w = col_w + s_o * num_neurons;
+    int32_t* sec_results = results - section_row_offset<R>(s_o, sec_size) * 16;
+
+    for(size_t s_i = 0; s_i < num_secs; ++s_i) {
+      if(!is_nonzero_sec_0[s_i]) {
+        continue;
+      }
+      for(size_t j = s_i * sec_size; j < (s_i + 1) * sec_size; ++j) {
+        const __m256i y = _mm256_loadu_si256((const __m256i*)(Y_0 + j * 16));
+        if(_mm256_testz_si256(y, y)) {
+          continue;
+        }
+        const __m256i y_lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(y));
+        const __m256i y_hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(y, 1));
+        for(int k = sec_col_w[j]; k < sec_col_w[j + 1]; ++k) {
+          int32_t* acc = sec_results + row_w[k] * 16;
+          const __m256i w = _mm256_set1_epi32(uint16_t(uniform_w ? 1 : val_w[k]));
+          _mm256_storeu_si256((__m256i*)acc, _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)acc), _mm256_madd_epi16(y_lo, w)));
+          _mm256_storeu_si256((__m256i*)(acc + 8), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(acc + 8)), _mm256_madd_epi16(y_hi, w)));
+        }
+      }
+    }
+
+    //fused rounding, clamp and nonzero test
+    //packs interleave the 128-bit halves of lanes 0-7 and 8-15, the permute restores their order
+    int16_t* sec_Y_1 = Y_1 + s_o * sec_size * 16;
+    __m256i any = zero;
+    for(size_t i = 0; i < sec_size; ++i) {
+      __m256i v[2];
+      const __m256i rounding = _mm256_set1_epi32(ValueTraits<int16_t>::rounding(s_o * sec_size + i));
+      for(size_t h = 0; h < 2; ++h) {
+        __m256i acc = _mm256_loadu_si256((const __m256i*)(results + i * 16 + h * 8));
+        acc = _mm256_add_epi32(offset_v, _mm256_mullo_epi32(scale_v, acc));
+        acc = _mm256_srai_epi32(_mm256_add_epi32(acc, rounding), FIXED_FRAC_BITS);
+        v[h] = _mm256_min_epi32(upper, _mm256_max_epi32(acc, zero));
+      }
+      __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(v[0], v[1]), 0xD8);
+      _mm256_storeu_si256((__m256i*)(sec_Y_1 + i * 16), packed);
+      any = _mm256_or_si256(any, packed);
+    }
+    is_nonzero_sec_1[s_o] = !_mm256_testz_si256(any, any);
+  }
+}
+
+#pragma GCC diagnostic pop
+
+#endif
+
+//SIMD push kernels are implemented for float, half, and int16_t, other types use the scalar kernel
+//F is the type the SIMD kernels are instantiated with, the casts are only taken for float and half
+template <typename T, typename R>
+void cpu_inference_dispatch(
+  const CPUKernel kernel,
+  const T* Y_0,
+  const bool* is_nonzero_row_0,
+  const uint64_t* active_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  const size_t beg_sec,
+  const size_t end_sec,
+  const int* col_w,
+  const R* row_w,
+  const T* val_w,
+  const bool uniform_w,
+  const typename ValueTraits<T>::acc_type bias,
+  bool* is_nonzero_row_1,
+  uint64_t* active_1,
+  T* Y_1,
+  typename ValueTraits<T>::acc_type* results
+) {
+#ifdef SNIG_ENABLE_X86_SIMD
+  using F = std::conditional_t<std::is_same<T, half>::value, half, float>;
+  if(std::is_same<T, float>::value || std::is_same<T, half>::value) {
+    switch(kernel) {
+      case CPUKernel::AVX512:
+        cpu_inference_avx512<F, R>(
+          (const F*)Y_0, is_nonzero_row_0, active_0, sec_size, num_secs, num_neurons, beg_sec, end_sec,
+          col_w, row_w, (const F*)val_w, uniform_w, (float)bias, is_nonzero_row_1, active_1, (F*)Y_1, (float*)results
+        );
+        return;
+      case CPUKernel::AVX2:
+        cpu_inference_avx2<F, R>(
+          (const F*)Y_0, is_nonzero_row_0, active_0, sec_size, num_secs, num_neurons, beg_sec, end_sec,
+          col_w, row_w, (const F*)val_w, uniform_w, (float)bias, is_nonzero_row_1, active_1, (F*)Y_1, (float*)results
+        );
+        return;
+      default:
+        break;
+    }
+  }
+  //every CPU with AVX-512 also supports AVX2
+  if(std::is_same<T, int16_t>::value && kernel != CPUKernel::SCALAR) {
+    cpu_inference_avx2_fixed<R>(
+      (const int16_t*)Y_0, is_nonzero_row_0, active_0, sec_size, num_secs, num_neurons, beg_sec, end_sec,
+      col_w, row_w, (const int16_t*)val_w, uniform_w, (int32_t)bias, is_nonzero_row_1, active_1, (int16_t*)Y_1, (int32_t*)results
+    );
+    return;
+  }
+#endif
+  cpu_inference<T, R>(
+    Y_0, is_nonzero_row_0, active_0, sec_size, num_secs, num_neurons, beg_sec, end_sec,
+    col_w, row_w, val_w, uniform_w, bias, is_nonzero_row_1, active_1, Y_1, results
+  );
+}
+
+template <typename T, typename R>
+void cpu_tile_inference_dispatch(
+  const CPUKernel kernel,
+  const T* Y_0,
+  const bool* is_nonzero_sec_0,
+  const size_t sec_size,
+  const size_t num_secs,
+  const size_t num_neurons,
+  const int* col_w,
+  const R* row_w,
+  const T* val_w,
+  const bool uniform_w,
+  const typename ValueTraits<T>::acc_type bias,
+  bool* is_nonzero_sec_1,
+  T* Y_1,
+  typename ValueTraits<T>::acc_type* results
+) {
+#ifdef SNIG_ENABLE_X86_SIMD
+  using F = std::conditional_t<std::is_same<T, half>::value, half, float>;
+  if(std::is_same<T, float>::value || std::is_same<T, half>::value) {
+    switch(kernel) {
+      case CPUKernel::AVX512:
+        cpu_tile_inference_avx512<F, R>(
+          (const F*)Y_0, is_nonzero_sec_0, sec_size, num_secs, num_neurons,
+          col_w, row_w, (const F*)val_w, uniform_w, (float)bias, is_nonzero_sec_1, (F*)Y_1, (float*)results
+        );
+        return;
+      case CPUKernel::AVX2:
+        cpu_tile_inference_avx2<F, R>(
+          (const F*)Y_0, is_nonzero_sec_0, sec_size, num_secs, num_neurons,
+          col_w, row_w, (const F*)val_w, uniform_w, (float)bias, is_nonzero_sec_1, (F*)Y_1, (float*)results
+        );
+        return;
+      default:
+        break;
+    }
+  }
+  //every CPU with AVX-512 also supports AVX2
+  if(std::is_same<T, int16_t>::value && kernel != CPUKernel::SCALAR) {
+    cpu_tile_inference_avx2_fixed<R>(
+      (const int16_t*)Y_0, is_nonzero_sec_0, sec_size, num_secs, num_neurons,
+      col_w, row_w, (const int16_t*)val_w, uniform_w, (int32_t)bias, is_nonzero_sec_1, (int16_t*)Y_1, (int32_t*)results
+    );
+    return;
+  }
+#endif
+  cpu_tile_inference<T, R>(
+    Y_0, is_nonzero_sec_0, sec_size, num_secs, num_neurons,
+    col_w, row_w, val_w, uniform_w, bias, is_nonzero_sec_1, Y_1, results
+  );
+}
+
+}// end of namespace snig ----------------------------------------------
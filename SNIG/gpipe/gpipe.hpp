@@ -151,7 +151,8 @@ void GPipe<T>::_set_parameters(
   Base<T>::_num_gpus = num_gpus;
   _num_layers_per_gpu = Base<T>::_num_layers / Base<T>::_num_gpus;
 
-  _batch_size = batch_size;
+  //buffers never hold more rows than the input file, and at least one row
+  _batch_size = std::max(std::min(batch_size, num_inputs), size_t{1});
   _batch_ylen = _batch_size * Base<T>::_num_neurons;
   _batch_ysize = _batch_ylen * sizeof(T);
 
@@ -197,7 +198,8 @@ void GPipe<T>::_infer() {
   }
   cudaSetDevice(0);
 
-  size_t num_batches = Base<T>::_num_inputs / _batch_size;
+  //the last batch holds the remaining inputs
+  size_t num_batches = (Base<T>::_num_inputs + _batch_size - 1) / _batch_size;
 
   std::vector<int*> dev_results(Base<T>::_num_gpus, nullptr);
 
@@ -205,13 +207,13 @@ void GPipe<T>::_infer() {
   std::vector<std::mutex> dev_que_mutex(Base<T>::_num_gpus);
   std::vector<std::condition_variable> dev_que_cv(Base<T>::_num_gpus);
   std::queue<size_t> first_dev_que;
-  for(size_t i = 0; i < num_batches + 1; ++i) {
+  for(size_t i = 0; i < num_batches; ++i) {
     first_dev_que.emplace(i * _batch_size);
   }
+  //_num_inputs marks the end of batches
+  first_dev_que.emplace(Base<T>::_num_inputs);
   dev_start_batch[0] = std::move(first_dev_que);
 
-  dim3 grid_dim(_batch_size, Base<T>::_num_secs, 1);
-
   #pragma omp parallel num_threads(Base<T>::_num_gpus)
   {
     bool stop = false;
@@ -255,9 +257,13 @@ void GPipe<T>::_infer() {
       _dev_is_nonzero_row[dev][0] = _source_is_nonzero_row + beg_inputs * Base<T>::_num_secs;
       dev_results[dev] = _results + beg_inputs;
 
+      //one block row per input, so a partial batch never touches rows past _num_inputs
+      size_t num_rows = std::min(_batch_size, Base<T>::_num_inputs - beg_inputs);
+      dim3 grid_dim(num_rows, Base<T>::_num_secs, 1);
+
       for(size_t cur_layer = dev * _num_layers_per_gpu; cur_layer < (dev + 1) * _num_layers_per_gpu; ++cur_layer) {
         int* roffw = _dev_W[cur_layer];
-        int* colsw = _dev_W[cur_layer] + Base<T>::_num_neurons * Base<T>::_num_secs + 1;
+        uint16_t* colsw = (uint16_t*)(_dev_W[cur_layer] + Base<T>::_num_neurons * Base<T>::_num_secs + 1);
         T* valsw = (T*)(_dev_W[cur_layer] + Base<T>::_p_w_index_len);
 
         snig_inference<T><<<grid_dim, Base<T>::_threads, sizeof(T) * Base<T>::_sec_size, infer_stream>>>(
@@ -269,6 +275,7 @@ void GPipe<T>::_infer() {
           roffw,
           colsw,
           valsw,
+          Base<T>::_uniform_w(cur_layer),
           Base<T>::_bias,
           _dev_is_nonzero_row[dev][(cur_layer + 1) % 2],
           _dev_Y[dev][(cur_layer + 1) % 2]
@@ -285,7 +292,7 @@ void GPipe<T>::_infer() {
       }
       else {
         //last device identify
-        identify<T><<<16, 512, 0, infer_stream>>>(_dev_Y[dev][0], _batch_size, Base<T>::_num_neurons, dev_results[dev]);
+        identify<T><<<16, 512, 0, infer_stream>>>(_dev_Y[dev][0], num_rows, Base<T>::_num_neurons, dev_results[dev]);
         checkCuda(cudaStreamSynchronize(infer_stream));
       }
     }
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 
 namespace snig{
 
@@ -11,8 +12,9 @@ void snig_inference(
   const size_t num_sec,
   const size_t num_neurons,
   const int* col_w,
-  const int* row_w,
+  const uint16_t* row_w,
   const T* val_w,
+  const bool uniform_w,
   const T bias,
   bool* is_nonzero_row_1,
   T* Y_1
@@ -31,8 +33,9 @@ void snig_inference(
   const size_t num_secs,
   const size_t num_neurons,
   const int* col_w,
-  const int* row_w,
+  const uint16_t* row_w,
   const T* val_w,
+  const bool uniform_w,
   const T bias,
   bool* is_nonzero_row_1,
   T* Y_1
@@ -91,10 +94,12 @@ void snig_inference(
       }
       int beg_w = col_w[blockIdx.y * num_neurons + j] + threadIdx.x;
       int end_w = col_w[blockIdx.y * num_neurons + j + 1];
+      //row indices are relative to the section of this block
       for(int k = beg_w; k < end_w; k += blockDim.x) {
         int roww = row_w[k];
-        T valw = val_w[k];
-        atomicAdd(&results[roww - blockIdx.y * sec_size], valY * valw);
+        //a uniform layer stores a single value
+        T valw = uniform_w ? val_w[0] : val_w[k];
+        atomicAdd(&results[roww], valY * valw);
       }
     }
   }
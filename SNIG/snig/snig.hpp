@@ -3,12 +3,14 @@
 #include <Eigen/Core>
 #include <taskflow/taskflow.hpp>
 #include <SNIG/utility/reader.hpp>
+#include <SNIG/utility/input_stream.hpp>
 #include <SNIG/utility/matrix_format.h>
 #include <SNIG/utility/cuda_error.hpp>
 #include <SNIG/snig/kernel.hpp>
 #include <SNIG/utility/scoring.hpp>
 #include <SNIG/base/base.hpp>
 #include <vector>
+#include <memory>
 
 namespace std {
   namespace fs = experimental::filesystem;  
@@ -28,8 +30,15 @@ class SNIG : public Base<T> {
     
     size_t _batch_size;
     size_t _num_weight_buffers;
-    T* _source_Y;
-    bool* _source_is_nonzero_row;
+
+    //ring of pinned host batch buffers filled by _input_stream
+    //each GPU holds the batch it is inferring until its next fetch
+    //and copies it into _dev_Y[dev][0] on the stream of its cudaflow,
+    //so the producer never touches memory a kernel may access
+    std::vector<T*> _source_Y;
+    std::vector<bool*> _source_is_nonzero_row;
+    std::unique_ptr<InputStream<T> > _input_stream;
+    std::vector<InputBatch<T> > _dev_batch;
     std::vector<std::vector<T*> > _dev_Y;
     std::vector<std::vector<bool*> > _dev_is_nonzero_row;
     std::vector<std::vector<int*> > _dev_W;
@@ -49,6 +58,8 @@ class SNIG : public Base<T> {
   
     void  _infer();
 
+    bool _fetch_input(const size_t dev);
+
     void _input_alloc();
 
     void _weight_alloc();
@@ -97,8 +108,15 @@ SNIG<T>::SNIG(
 template <typename T>
 SNIG<T>::~SNIG() {
 
-  checkCuda(cudaFree(_source_Y));
-  checkCuda(cudaFree(_source_is_nonzero_row));
+  //stop the producer before its buffers are freed
+  _input_stream.reset();
+
+  for(auto& each_Y : _source_Y) {
+    checkCuda(cudaFreeHost(each_Y));
+  }
+  for(auto& each_is_nonzero_row : _source_is_nonzero_row) {
+    checkCuda(cudaFreeHost(each_is_nonzero_row));
+  }
 
   for(auto& W_in_dev : _dev_W) {
     for(auto& each_W : W_in_dev) {
@@ -106,10 +124,14 @@ SNIG<T>::~SNIG() {
     }
   }
   for(auto& Y_in_dev : _dev_Y) {
-      checkCuda(cudaFree(Y_in_dev[1]));
+    for(auto& each_Y : Y_in_dev) {
+      checkCuda(cudaFree(each_Y));
+    }
   }
   for(auto& rowsY_in_dev : _dev_is_nonzero_row) {
-      checkCuda(cudaFree(rowsY_in_dev[1]));
+    for(auto& each_is_nonzero_row : rowsY_in_dev) {
+      checkCuda(cudaFree(each_is_nonzero_row));
+    }
   }
 
   checkCuda(cudaFree(_results));
@@ -154,7 +176,8 @@ void SNIG<T>::_set_parameters(
   Base<T>::_num_gpus = num_gpus;
   _num_weight_buffers = num_weight_buffers;
 
-  _batch_size = batch_size;
+  //buffers never hold more rows than the input file, and at least one row
+  _batch_size = std::max(std::min(batch_size, num_inputs), size_t{1});
   _batch_ylen = _batch_size * Base<T>::_num_neurons;
   _batch_ysize = _batch_ylen * sizeof(T);
 
@@ -175,8 +198,17 @@ void SNIG<T>::_preprocess(const std::fs::path& input_path) {
   //final results allocation
   _result_alloc();
   
-  //read input
-  read_input_binary<T>(input_path, _source_Y);
+  //start streaming input
+  _input_stream = std::make_unique<InputStream<T> >(
+    input_path,
+    Base<T>::_num_inputs,
+    _batch_size,
+    Base<T>::_num_neurons,
+    Base<T>::_sec_size,
+    Base<T>::_num_secs,
+    _source_Y,
+    _source_is_nonzero_row
+  );
 
   Base<T>::toc();
   Base<T>::log("Finish preprocessing with ", Base<T>::duration(), " ms", "\n");
@@ -197,11 +229,8 @@ void SNIG<T>::_infer() {
   cudaflows.reserve(Base<T>::_num_gpus);
   fetchs.reserve(Base<T>::_num_gpus);
 
-  std::atomic<size_t> finished_inputs{0};
   std::vector<int*> dev_results(Base<T>::_num_gpus, nullptr);
 
-  dim3 grid_dim(_batch_size, Base<T>::_num_secs, 1);
-
   tf::Task start = taskflow.emplace([](){
   }).name("start");
 
@@ -209,14 +238,9 @@ void SNIG<T>::_infer() {
     first_fetchs.emplace_back(taskflow.emplace([&, dev](){
       cudaSetDevice(dev);
       int is_end = 1;
-      size_t beg_inputs = finished_inputs.fetch_add(_batch_size);
-      if(beg_inputs < Base<T>::_num_inputs) {
-        _dev_Y[dev][0] = _source_Y + beg_inputs * Base<T>::_num_neurons;
-        _dev_is_nonzero_row[dev][0] = _source_is_nonzero_row + beg_inputs * Base<T>::_num_secs;
-        dev_results[dev] = _results + beg_inputs;
-        checkCuda(cudaMemPrefetchAsync(_dev_Y[dev][0], _batch_ysize, dev, NULL));
-        checkCuda(cudaMemPrefetchAsync(_dev_is_nonzero_row[dev][0], sizeof(bool) * _batch_size * Base<T>::_num_secs, dev, NULL));
-        checkCuda(cudaMemPrefetchAsync(dev_results[dev], sizeof(int) * _batch_size, dev, NULL));
+      if(_fetch_input(dev)) {
+        dev_results[dev] = _results + _dev_batch[dev].beg_inputs;
+        checkCuda(cudaMemPrefetchAsync(dev_results[dev], sizeof(int) * _dev_batch[dev].num_rows, dev, NULL));
         is_end = 0;
       }
       return is_end;
@@ -224,11 +248,27 @@ void SNIG<T>::_infer() {
 
     cudaflows.emplace_back(taskflow.emplace([&, dev](tf::cudaFlow& cf){
       cf.device(dev);
+
+      //the graph is rebuilt for every batch, so a partial last batch only launches its own rows
+      size_t num_rows = _dev_batch[dev].num_rows;
+      dim3 grid_dim(num_rows, Base<T>::_num_secs, 1);
       std::vector<tf::cudaTask> weight_copies;
       std::vector<tf::cudaTask> infers;
       weight_copies.reserve(Base<T>::_num_layers);
       infers.reserve(Base<T>::_num_layers);
 
+      //the staged batch is copied in on the same stream as the layers
+      tf::cudaTask input_copy = cf.copy(
+        _dev_Y[dev][0],
+        _dev_batch[dev].Y,
+        num_rows * Base<T>::_num_neurons
+      ).name("input_copy");
+      tf::cudaTask rows_copy = cf.copy(
+        _dev_is_nonzero_row[dev][0],
+        _dev_batch[dev].is_nonzero_row,
+        num_rows * Base<T>::_num_secs
+      ).name("is_nonzero_row_copy");
+
       for(size_t cur_layer = 0; cur_layer < Base<T>::_num_layers; cur_layer += _num_weight_buffers) {
         for(size_t k = 0; k < _num_weight_buffers; ++k) {
           //tasks of cudaflow
@@ -240,7 +280,7 @@ void SNIG<T>::_infer() {
 
           // transformed CSC weight matrix equals to CSR with exchanged row and col
           int* col_w = _dev_W[dev][k];
-          int* row_w = _dev_W[dev][k] + Base<T>::_num_neurons * Base<T>::_num_secs + 1;
+          uint16_t* row_w = (uint16_t*)(_dev_W[dev][k] + Base<T>::_num_neurons * Base<T>::_num_secs + 1);
           T* val_w = (T*)(_dev_W[dev][k] + Base<T>::_p_w_index_len);
           infers.emplace_back(cf.kernel(
             grid_dim,
@@ -255,6 +295,7 @@ void SNIG<T>::_infer() {
             col_w,
             row_w,
             val_w,
+            Base<T>::_uniform_w(cur_layer + k),
             Base<T>::_bias,
             _dev_is_nonzero_row[dev][(k + 1) % 2],
             _dev_Y[dev][(k + 1) % 2]
@@ -263,9 +304,11 @@ void SNIG<T>::_infer() {
       }
 
       // TODO: consider parameterizing the thread numbers
-      tf::cudaTask ident = cf.kernel(16, 512, 0, identify<T>, _dev_Y[dev][0], _batch_size, Base<T>::_num_neurons, dev_results[dev]);
+      tf::cudaTask ident = cf.kernel(16, 512, 0, identify<T>, _dev_Y[dev][0], num_rows, Base<T>::_num_neurons, dev_results[dev]);
 
       //dependencies of cudaflow
+      input_copy.precede(infers[0]);
+      rows_copy.precede(infers[0]);
       for(size_t cur_layer = 0; cur_layer < Base<T>::_num_layers; ++cur_layer) {
         weight_copies[cur_layer].precede(infers[cur_layer]);
 
@@ -282,14 +325,9 @@ void SNIG<T>::_infer() {
     fetchs.emplace_back(taskflow.emplace([&, dev](){
       cudaSetDevice(dev);
       int is_end = 1;
-      size_t beg_inputs = finished_inputs.fetch_add(_batch_size);
-      if(beg_inputs < Base<T>::_num_inputs) {
-        _dev_Y[dev][0] = _source_Y + beg_inputs * Base<T>::_num_neurons;
-        _dev_is_nonzero_row[dev][0] = _source_is_nonzero_row + beg_inputs * Base<T>::_num_secs;
-        dev_results[dev] = _results + beg_inputs;
-        checkCuda(cudaMemPrefetchAsync(_dev_Y[dev][0], _batch_ysize, dev, NULL));
-        checkCuda(cudaMemPrefetchAsync(_dev_is_nonzero_row[dev][0], sizeof(bool) * _batch_size * Base<T>::_num_secs, dev, NULL));
-        checkCuda(cudaMemPrefetchAsync(dev_results[dev], sizeof(int) * _batch_size, dev, NULL));
+      if(_fetch_input(dev)) {
+        dev_results[dev] = _results + _dev_batch[dev].beg_inputs;
+        checkCuda(cudaMemPrefetchAsync(dev_results[dev], sizeof(int) * _dev_batch[dev].num_rows, dev, NULL));
         is_end = 0;
       }
       return is_end;
@@ -315,6 +353,17 @@ void SNIG<T>::_infer() {
   Base<T>::log("Finish inference with ", Base<T>::duration(), " ms", "\n");
 }
 
+//the previous batch of dev has finished, so its buffer goes back to the ring
+//the cudaflow of dev copies the popped batch to the GPU
+template <typename T>
+bool SNIG<T>::_fetch_input(const size_t dev) {
+  if(_dev_batch[dev].Y != nullptr) {
+    _input_stream->release(_dev_batch[dev]);
+    _dev_batch[dev] = InputBatch<T>{};
+  }
+  return _input_stream->pop(_dev_batch[dev]);
+}
+
 template <typename T>
 void SNIG<T>::_weight_alloc() {
   std::vector<int*> W(_num_weight_buffers, nullptr);
@@ -334,21 +383,32 @@ void SNIG<T>::_weight_alloc() {
 
 template <typename T>
 void SNIG<T>::_input_alloc() {
-  size_t ylen = Base<T>::_num_inputs *  Base<T>::_num_neurons;
-  size_t ysize = ylen * sizeof(T);
-
-  checkCuda(cudaMallocManaged(&_source_Y, ysize));
-  checkCuda(cudaMallocManaged(&_source_is_nonzero_row, sizeof(bool) * Base<T>::_num_inputs * Base<T>::_num_secs));
-  checkCuda(cudaMemset(_source_is_nonzero_row, 1, sizeof(bool) * Base<T>::_num_inputs * Base<T>::_num_secs));
+  //one batch in flight and one staged per GPU
+  //buffers are written on the host by the producer of _input_stream
+  //and pinned so that the cudaflows copy them asynchronously
+  for(size_t b = 0; b < 2 * Base<T>::_num_gpus; ++b) {
+    T* Y;
+    bool* is_nonzero_row;
+    checkCuda(cudaMallocHost(&Y, _batch_ysize));
+    checkCuda(cudaMallocHost(&is_nonzero_row, sizeof(bool) * _batch_size * Base<T>::_num_secs));
+    std::memset(Y, 0, _batch_ysize);
+    std::memset(is_nonzero_row, 0, sizeof(bool) * _batch_size * Base<T>::_num_secs);
+    _source_Y.push_back(Y);
+    _source_is_nonzero_row.push_back(is_nonzero_row);
+  }
+  _dev_batch.resize(Base<T>::_num_gpus);
 
+  //buffer 0 receives the batch, buffer 1 holds the other activations of each layer
   std::vector<T*> Y{2, nullptr};
   std::vector<bool*> is_nonzero_row{2, nullptr};
   for(size_t dev = 0; dev < Base<T>::_num_gpus; ++dev) {
     cudaSetDevice(dev);
-    checkCuda(cudaMalloc(&Y[1], _batch_ysize));
-    checkCuda(cudaMalloc(&is_nonzero_row[1], sizeof(bool) * _batch_size * Base<T>::_num_secs));
-    checkCuda(cudaMemset(Y[1], 0, _batch_ysize));
-    checkCuda(cudaMemset(is_nonzero_row[1], 0, sizeof(bool) * _batch_size * Base<T>::_num_secs));
+    for(size_t k = 0; k < 2; ++k) {
+      checkCuda(cudaMalloc(&Y[k], _batch_ysize));
+      checkCuda(cudaMalloc(&is_nonzero_row[k], sizeof(bool) * _batch_size * Base<T>::_num_secs));
+      checkCuda(cudaMemset(Y[k], 0, _batch_ysize));
+      checkCuda(cudaMemset(is_nonzero_row[k], 0, sizeof(bool) * _batch_size * Base<T>::_num_secs));
+    }
     _dev_Y.push_back(Y);
     _dev_is_nonzero_row.push_back(is_nonzero_row);
   }
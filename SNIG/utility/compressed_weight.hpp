@@ -0,0 +1,430 @@
+#pragma once
+#include <experimental/filesystem>
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <SNIG/utility/model_format.hpp>
+#include <SNIG/utility/mapped_weight.hpp>
+#include <SNIG/utility/layer_codec.hpp>
+
+namespace std {
+  namespace fs = experimental::filesystem;
+}
+
+namespace snig {
+
+template <typename T>
+class CompressedWeight {
+
+  //All layers of the weight held in memory in the format of layer_codec.hpp
+  //Layers are decoded on demand into a small ring of slots of the packed CSC layout
+  //with uint16_t row indices.
+  //A decoder thread fills slots for the layers just ahead of prefetch,
+  //and a worker that misses a layer decodes it into a free slot by itself.
+  //A layer stays in its slot while it is acquired by any worker.
+
+  public:
+
+    //weight_path is a container, a directory holding one,
+    //or a directory of layer files partitioned into N_SLAB sections
+    CompressedWeight(
+      const std::fs::path& weight_path,
+      const size_t num_neurons_per_layer,
+      const size_t num_layers,
+      const size_t N_SLAB,
+      const size_t readahead_layers = 2
+    );
+
+    ~CompressedWeight();
+
+    CompressedWeight(const CompressedWeight&) = delete;
+
+    CompressedWeight& operator = (const CompressedWeight&) = delete;
+
+    size_t num_layers() const;
+
+    size_t max_nnz() const;
+
+    size_t max_vals() const;
+
+    size_t sec_size() const;
+
+    size_t num_secs() const;
+
+    bool uniform(const size_t layer) const;
+
+    //bytes of all encoded layers
+    size_t compressed_size() const;
+
+    //bytes of the same layers in the packed layout with uint16_t row indices
+    size_t decoded_size() const;
+
+    //allocates num_slots decoded layers and starts the decoder thread
+    //num_slots must exceed the number of workers acquiring layers at the same time
+    void reserve(const size_t num_slots);
+
+    //decodes layer if it is not in a slot, and pins it until release
+    void acquire(const size_t layer);
+
+    void release(const size_t layer);
+
+    //asks the decoder thread for layers [layer, layer + readahead_layers)
+    void prefetch(const size_t layer);
+
+    //views of an acquired layer
+    const int* col_w(const size_t layer) const;
+
+    const uint16_t* short_row_w(const size_t layer) const;
+
+    const T* val_w(const size_t layer) const;
+
+  private:
+
+    struct Slot {
+      std::vector<int> col_w;
+      std::vector<uint16_t> short_row_w;
+      const T* val_w {nullptr};
+      //-1 if the slot holds no layer
+      long layer {-1};
+      size_t num_users {0};
+      //false while the layer is being decoded
+      bool ready {true};
+      size_t last_use {0};
+    };
+
+    std::vector<std::vector<uint64_t> > _layers;
+    std::vector<bool> _uniform;
+    size_t _num_neurons;
+    size_t _max_nnz {0};
+    size_t _max_vals {0};
+    size_t _sec_size;
+    size_t _num_secs;
+    size_t _readahead_layers;
+
+    //all members below are guarded by _mutex
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::vector<Slot> _slots;
+    //slot of each layer, -1 if the layer is not decoded
+    std::vector<long> _slot_of;
+    std::deque<size_t> _requests;
+    std::vector<bool> _requested;
+    size_t _clock {0};
+    bool _stop {false};
+
+    std::thread _decoder;
+
+    void _encode(const MappedWeight<T>& mapped, const size_t layer);
+
+    //least recently used slot that is neither pinned nor being decoded, -1 if none
+    //must be called with _mutex held
+    long _find_free_slot() const;
+
+    //claims slot for layer, to be decoded outside of _mutex
+    //must be called with _mutex held
+    void _claim(const long slot, const size_t layer);
+
+    void _decode(const long slot, const size_t layer);
+
+    void _run_decoder();
+};
+
+// ----------------------------------------------------------------------------
+// Definition of CompressedWeight
+// ----------------------------------------------------------------------------
+
+template <typename T>
+CompressedWeight<T>::CompressedWeight(
+  const std::fs::path& weight_path,
+  const size_t num_neurons_per_layer,
+  const size_t num_layers,
+  const size_t N_SLAB,
+  const size_t readahead_layers
+) :
+  _layers(num_layers),
+  _uniform(num_layers),
+  _num_neurons{num_neurons_per_layer},
+  _readahead_layers{std::max(readahead_layers, size_t{1})},
+  _slot_of(num_layers, -1),
+  _requested(num_layers, false)
+{
+  //layers are encoded from a mapping of the weight, so the decoded weight
+  //never has to fit into memory at once
+  MappedWeight<T> mapped(weight_path, num_neurons_per_layer, num_layers, N_SLAB);
+  _sec_size = mapped.sec_size();
+  _num_secs = mapped.num_secs();
+  _max_nnz = mapped.max_nnz();
+  _max_vals = mapped.max_vals();
+  if(!fits_short_row_index(_sec_size)) {
+    throw std::runtime_error("section size exceeds the range of 16-bit row indices");
+  }
+  for(size_t l = 0; l < num_layers; ++l) {
+    _uniform[l] = mapped.uniform(l);
+  }
+
+  //exceptions must not leave an OpenMP region
+  std::exception_ptr error;
+  #pragma omp parallel for schedule(dynamic)
+  for(size_t l = 0; l < num_layers; ++l) {
+    try {
+      _encode(mapped, l);
+    }
+    catch(...) {
+      #pragma omp critical
+      error = std::current_exception();
+    }
+  }
+  if(error) {
+    std::rethrow_exception(error);
+  }
+}
+
+template <typename T>
+CompressedWeight<T>::~CompressedWeight() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _cv.notify_all();
+  if(_decoder.joinable()) {
+    _decoder.join();
+  }
+}
+
+template <typename T>
+void CompressedWeight<T>::_encode(const MappedWeight<T>& mapped, const size_t layer) {
+  const uint16_t* short_row_w = mapped.short_row_w(layer);
+  std::vector<uint16_t> converted;
+  if(!mapped.short_index()) {
+    converted.resize(mapped.nnz(layer));
+    to_short_row_index(mapped.col_w(layer), mapped.row_w(layer), _num_neurons, _num_secs, converted.data());
+    short_row_w = converted.data();
+  }
+
+  _layers[layer] = encode_layer<T>(
+    mapped.col_w(layer),
+    short_row_w,
+    mapped.val_w(layer),
+    mapped.uniform(layer) ? 1 : mapped.nnz(layer),
+    _num_neurons,
+    _num_secs
+  );
+}
+
+template <typename T>
+void CompressedWeight<T>::reserve(const size_t num_slots) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  if(_slots.size() >= num_slots) {
+    return;
+  }
+  _slots.resize(num_slots);
+  for(auto& slot : _slots) {
+    slot.col_w.resize(_num_neurons * _num_secs + 1);
+    slot.short_row_w.resize(_max_nnz);
+  }
+  if(!_decoder.joinable()) {
+    _decoder = std::thread([this](){ _run_decoder(); });
+  }
+}
+
+template <typename T>
+long CompressedWeight<T>::_find_free_slot() const {
+  long free_slot = -1;
+  for(size_t s = 0; s < _slots.size(); ++s) {
+    const Slot& slot = _slots[s];
+    if(slot.num_users > 0 || !slot.ready) {
+      continue;
+    }
+    if(free_slot < 0 || slot.layer < 0 || slot.last_use < _slots[free_slot].last_use) {
+      free_slot = s;
+      if(slot.layer < 0) {
+        break;
+      }
+    }
+  }
+  return free_slot;
+}
+
+template <typename T>
+void CompressedWeight<T>::_claim(const long slot, const size_t layer) {
+  Slot& s = _slots[slot];
+  if(s.layer >= 0) {
+    _slot_of[s.layer] = -1;
+  }
+  s.layer = layer;
+  s.ready = false;
+  _slot_of[layer] = slot;
+}
+
+template <typename T>
+void CompressedWeight<T>::_decode(const long slot, const size_t layer) {
+  Slot& s = _slots[slot];
+  s.val_w = decode_layer<T>(
+    _layers[layer].data(),
+    _num_neurons,
+    _num_secs,
+    s.col_w.data(),
+    s.short_row_w.data()
+  );
+}
+
+template <typename T>
+void CompressedWeight<T>::acquire(const size_t layer) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  if(_slots.empty()) {
+    throw std::runtime_error("no slot is reserved for the compressed weight");
+  }
+  while(true) {
+    long slot = _slot_of[layer];
+    if(slot >= 0) {
+      //the layer may still be decoded by another thread
+      _slots[slot].num_users++;
+      _slots[slot].last_use = ++_clock;
+      _cv.wait(lock, [&](){ return _slots[slot].ready; });
+      return;
+    }
+
+    slot = _find_free_slot();
+    if(slot >= 0) {
+      _claim(slot, layer);
+      _slots[slot].num_users++;
+      _slots[slot].last_use = ++_clock;
+      lock.unlock();
+      _decode(slot, layer);
+      lock.lock();
+      _slots[slot].ready = true;
+      _cv.notify_all();
+      return;
+    }
+
+    _cv.wait(lock);
+  }
+}
+
+template <typename T>
+void CompressedWeight<T>::release(const size_t layer) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _slots[_slot_of[layer]].num_users--;
+  }
+  _cv.notify_all();
+}
+
+template <typename T>
+void CompressedWeight<T>::prefetch(const size_t layer) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t end = std::min(layer + _readahead_layers, _layers.size());
+    for(size_t l = layer; l < end; ++l) {
+      if(_slot_of[l] < 0 && !_requested[l]) {
+        _requested[l] = true;
+        _requests.push_back(l);
+      }
+    }
+  }
+  _cv.notify_all();
+}
+
+template <typename T>
+void CompressedWeight<T>::_run_decoder() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while(true) {
+    _cv.wait(lock, [&](){ return _stop || !_requests.empty(); });
+    if(_stop) {
+      return;
+    }
+
+    size_t layer = _requests.front();
+    _requests.pop_front();
+    _requested[layer] = false;
+
+    //a request is dropped if the layer is already decoded or every slot is in use,
+    //the worker then decodes the layer by itself
+    long slot = _slot_of[layer] < 0 ? _find_free_slot() : -1;
+    if(slot < 0) {
+      continue;
+    }
+    _claim(slot, layer);
+    _slots[slot].last_use = ++_clock;
+    lock.unlock();
+    _decode(slot, layer);
+    lock.lock();
+    _slots[slot].ready = true;
+    _cv.notify_all();
+  }
+}
+
+template <typename T>
+size_t CompressedWeight<T>::num_layers() const {
+  return _layers.size();
+}
+
+template <typename T>
+size_t CompressedWeight<T>::max_nnz() const {
+  return _max_nnz;
+}
+
+template <typename T>
+size_t CompressedWeight<T>::max_vals() const {
+  return _max_vals;
+}
+
+template <typename T>
+size_t CompressedWeight<T>::sec_size() const {
+  return _sec_size;
+}
+
+template <typename T>
+size_t CompressedWeight<T>::num_secs() const {
+  return _num_secs;
+}
+
+template <typename T>
+bool CompressedWeight<T>::uniform(const size_t layer) const {
+  return _uniform[layer];
+}
+
+template <typename T>
+size_t CompressedWeight<T>::compressed_size() const {
+  size_t size = 0;
+  for(const auto& layer : _layers) {
+    size += sizeof(uint64_t) * layer.size();
+  }
+  return size;
+}
+
+template <typename T>
+size_t CompressedWeight<T>::decoded_size() const {
+  size_t size = 0;
+  for(const auto& layer : _layers) {
+    size += sizeof(int) * (_num_neurons * _num_secs + 1)
+      + sizeof(uint16_t) * encoded_nnz(layer.data())
+      + sizeof(T) * encoded_num_vals(layer.data());
+  }
+  return size;
+}
+
+template <typename T>
+const int* CompressedWeight<T>::col_w(const size_t layer) const {
+  return _slots[_slot_of[layer]].col_w.data();
+}
+
+template <typename T>
+const uint16_t* CompressedWeight<T>::short_row_w(const size_t layer) const {
+  return _slots[_slot_of[layer]].short_row_w.data();
+}
+
+template <typename T>
+const T* CompressedWeight<T>::val_w(const size_t layer) const {
+  return _slots[_slot_of[layer]].val_w;
+}
+
+}// end of namespace snig ----------------------------------------------
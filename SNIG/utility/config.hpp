@@ -0,0 +1,18 @@
+#pragma once
+
+//SNIG_ENABLE_CUDA is defined whenever SNIG is compiled by nvcc.
+//Otherwise only the host components are available
+//(reader, converter, scoring, and the CPU engine).
+#if defined(__CUDA__) || defined(__CUDACC__)
+#define SNIG_ENABLE_CUDA
+#endif
+
+//Cache budget (in bytes) of one section in host-only builds.
+//The default equals sharedMemPerBlock of NVIDIA GPUs
+//so that binary weight files stay interchangeable with CUDA builds.
+#ifndef SNIG_SEC_CACHE_SIZE
+#define SNIG_SEC_CACHE_SIZE 49152
+#endif
+
+//host storage type of half precision values
+#include <SNIG/utility/half.hpp>
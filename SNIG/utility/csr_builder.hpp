@@ -0,0 +1,183 @@
+#pragma once
+#include <vector>
+#include <numeric>
+#include <stdexcept>
+#include <algorithm>
+#include <SNIG/utility/utility.hpp>
+
+namespace snig {
+
+template <typename T>
+class CSRBuilder {
+
+  //Two-pass counting-sort construction of CSR arrays
+  //The same entries are visited twice, e.g. by parsing the same data twice,
+  //and each worker must see the same entries in both passes.
+  //Pass one counts the entries of every (worker, row).
+  //start() turns the counts into row offsets with a prefix sum and
+  //into the first position of every (worker, row).
+  //Pass two scatters each entry straight into col_array and data_array,
+  //so no entry is buffered between the passes.
+  //Entries of a row keep the worker order and, within a worker, the visiting order.
+
+  public:
+
+    CSRBuilder(const size_t num_rows, const size_t num_workers);
+
+    //pass one
+    void count(const size_t worker, const int row);
+
+    //number of entries counted in pass one
+    size_t nnz() const;
+
+    size_t num_workers() const;
+
+    size_t num_rows() const;
+
+    //the number of rows can be set after counting, e.g. once it is known from the data
+    void set_num_rows(const size_t num_rows);
+
+    //row_array holds num_rows + 1 offsets, col_array and data_array hold nnz() entries
+    //row_array is written here, col_array and data_array by fill()
+    void start(int* row_array, int* col_array, T* data_array);
+
+    //pass two
+    void fill(const size_t worker, const int row, const int col, const T value);
+
+    //checks that pass two placed exactly the entries counted in pass one
+    void finish();
+
+    //keeps the counters for the next matrix
+    void clear();
+
+  private:
+
+    size_t _num_rows;
+    size_t _nnz {0};
+    std::vector<std::vector<int> > _counts;
+    std::vector<size_t> _filled;
+
+    int* _row_array {nullptr};
+    int* _col_array {nullptr};
+    T* _data_array {nullptr};
+};
+
+// ----------------------------------------------------------------------------
+// Definition of CSRBuilder
+// ----------------------------------------------------------------------------
+
+template <typename T>
+CSRBuilder<T>::CSRBuilder(const size_t num_rows, const size_t num_workers) :
+  _num_rows{num_rows},
+  _counts(std::max(num_workers, size_t{1}), std::vector<int>(num_rows, 0)),
+  _filled(_counts.size(), 0)
+{
+}
+
+template <typename T>
+void CSRBuilder<T>::count(const size_t worker, const int row) {
+  if(row < 0) {
+    throw std::runtime_error("CSR entry out of range");
+  }
+  //without a number of rows, the counters grow with the rows seen in this pass
+  auto& counts = _counts[worker];
+  if(static_cast<size_t>(row) >= counts.size()) {
+    if(_num_rows > 0) {
+      throw std::runtime_error("CSR entry out of range");
+    }
+    counts.resize(std::max(static_cast<size_t>(row) + 1, counts.size() * 2), 0);
+  }
+  ++counts[row];
+}
+
+template <typename T>
+size_t CSRBuilder<T>::nnz() const {
+  size_t nnz = 0;
+  for(auto& counts : _counts) {
+    nnz += std::accumulate(counts.begin(), counts.end(), size_t{0});
+  }
+  return nnz;
+}
+
+template <typename T>
+size_t CSRBuilder<T>::num_workers() const {
+  return _counts.size();
+}
+
+template <typename T>
+size_t CSRBuilder<T>::num_rows() const {
+  return _num_rows;
+}
+
+template <typename T>
+void CSRBuilder<T>::set_num_rows(const size_t num_rows) {
+  _num_rows = num_rows;
+}
+
+template <typename T>
+void CSRBuilder<T>::start(int* row_array, int* col_array, T* data_array) {
+  const size_t num_workers = _counts.size();
+
+  for(auto& counts : _counts) {
+    if(std::any_of(counts.begin() + std::min(counts.size(), _num_rows), counts.end(), [](int c) { return c != 0; })) {
+      throw std::runtime_error("CSR entry out of range");
+    }
+    counts.resize(_num_rows, 0);
+  }
+
+  //exclusive prefix sum over rows, then over workers within a row
+  //_counts[w][r] becomes the first position of worker w in row r
+  int offset = 0;
+  for(size_t r = 0; r < _num_rows; ++r) {
+    row_array[r] = offset;
+    for(size_t w = 0; w < num_workers; ++w) {
+      int count = _counts[w][r];
+      _counts[w][r] = offset;
+      offset += count;
+    }
+  }
+  row_array[_num_rows] = offset;
+
+  _nnz = offset;
+  std::fill(_filled.begin(), _filled.end(), 0);
+  _row_array = row_array;
+  _col_array = col_array;
+  _data_array = data_array;
+}
+
+template <typename T>
+void CSRBuilder<T>::fill(const size_t worker, const int row, const int col, const T value) {
+  if(row < 0 || static_cast<size_t>(row) >= _num_rows) {
+    throw std::runtime_error("CSR entry out of range");
+  }
+  int k = _counts[worker][row]++;
+  //an entry not seen in pass one would run into the next (worker, row)
+  if(static_cast<size_t>(k) >= _nnz) {
+    throw std::runtime_error("CSR entries changed between the passes");
+  }
+  _col_array[k] = col;
+  _data_array[k] = value;
+  ++_filled[worker];
+}
+
+template <typename T>
+void CSRBuilder<T>::finish() {
+  //the last worker of every row must end where the next row begins
+  size_t filled = std::accumulate(_filled.begin(), _filled.end(), size_t{0});
+  bool complete = (filled == _nnz);
+  for(size_t r = 0; complete && r < _num_rows; ++r) {
+    complete = (_counts.back()[r] == _row_array[r + 1]);
+  }
+  if(!complete) {
+    throw std::runtime_error("CSR entries changed between the passes");
+  }
+}
+
+template <typename T>
+void CSRBuilder<T>::clear() {
+  for(auto& counts : _counts) {
+    counts.assign(_num_rows, 0);
+  }
+}
+
+}// end of namespace snig ----------------------------------------------
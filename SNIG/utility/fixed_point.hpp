@@ -0,0 +1,151 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <SNIG/utility/half.hpp>
+
+namespace snig {
+
+//Arithmetic of the data types of the CPU engine
+//
+//Kernels accumulate products in acc_type and call activate on the accumulator
+//of a neuron, which applies min(32, max(0, .)) and converts it back to T.
+//Floating point types compute directly in T.
+//
+//int16_t holds Q8.7 fixed point weights (7 fractional bits)
+//and Q5.10 activations (10 fractional bits).
+//Weights of the challenge are multiples of 1/16, so they are exact.
+//Activations are not: a bias such as -0.3 has no binary fixed point value,
+//so the activation of every neuron is rounded to 10 fractional bits,
+//and activations saturate at 32 - 1/1024, the largest Q5.10 value.
+//A neuron of the challenge sums 32 inputs of weight 1/16, which doubles an error
+//shared by all inputs, so rounding every neuron the same way drifts all rows upward
+//by a factor of two per layer and keeps dying rows alive.
+//Each neuron therefore rounds with its own offset spread over [0, 1) by a hash
+//of its index, the errors of the inputs of a neuron cancel instead of adding up.
+//Products carry 17 fractional bits and are accumulated in int32_t
+//together with the bias, shifting out the 7 bits of the weight gives the activation.
+//A uniform layer accumulates raw inputs (10 fractional bits),
+//multiplied by its single value they also carry 17 fractional bits.
+//Results are therefore close to, but not always identical with, float.
+
+//half only stores values, products are accumulated in float.
+//Activations of [16, 32] are rounded to multiples of 1/64.
+
+constexpr int FIXED_FRAC_BITS = 7;
+
+constexpr int FIXED_ACTIVATION_FRAC_BITS = 10;
+
+//largest Q5.10 activation
+constexpr int FIXED_ACTIVATION_MAX = std::numeric_limits<int16_t>::max();
+
+template <typename T>
+struct ValueTraits {
+  using acc_type = T;
+
+  //type of the values in input and weight text files
+  using real_type = T;
+
+  static T from_real(const double v) {
+    return static_cast<T>(v);
+  }
+
+  //value of an input activation
+  static T from_input(const double v) {
+    return from_real(v);
+  }
+
+  //bias in the unit of the accumulator
+  static acc_type bias(const double v) {
+    return static_cast<acc_type>(v);
+  }
+
+  static acc_type mul(const T y, const T w) {
+    return y * w;
+  }
+
+  static T activate(const acc_type acc, const size_t) {
+    return std::min(T(32), std::max(acc, T(0)));
+  }
+};
+
+template <>
+struct ValueTraits<int16_t> {
+  using acc_type = int32_t;
+
+  using real_type = float;
+
+  //rounds to the nearest value, throws if v is out of range
+  static int16_t from_real(const double v) {
+    double q = std::round(std::ldexp(v, FIXED_FRAC_BITS));
+    if(q < std::numeric_limits<int16_t>::min() || q > std::numeric_limits<int16_t>::max()) {
+      throw std::runtime_error("value " + std::to_string(v) + " exceeds the range of Q8.7 fixed point");
+    }
+    return static_cast<int16_t>(q);
+  }
+
+  //rounds to the nearest Q5.10 value, throws if v is out of range
+  static int16_t from_input(const double v) {
+    double q = std::round(std::ldexp(v, FIXED_ACTIVATION_FRAC_BITS));
+    if(q < std::numeric_limits<int16_t>::min() || q > std::numeric_limits<int16_t>::max()) {
+      throw std::runtime_error("input " + std::to_string(v) + " exceeds the range of Q5.10 fixed point");
+    }
+    return static_cast<int16_t>(q);
+  }
+
+  static int32_t bias(const double v) {
+    return static_cast<int32_t>(std::lround(std::ldexp(v, FIXED_FRAC_BITS + FIXED_ACTIVATION_FRAC_BITS)));
+  }
+
+  static int32_t mul(const int16_t y, const int16_t w) {
+    return int32_t(y) * w;
+  }
+
+  //offset in [0, 2^7) added to the accumulator of a neuron before the shift
+  static int32_t rounding(const size_t neuron) {
+    return static_cast<int32_t>((static_cast<uint32_t>(neuron) * 2654435761u) >> (32 - FIXED_FRAC_BITS));
+  }
+
+  //rounds to 10 fractional bits with the offset of the neuron
+  static int16_t activate(const int32_t acc, const size_t neuron) {
+    int32_t v = (acc + rounding(neuron)) >> FIXED_FRAC_BITS;
+    return static_cast<int16_t>(std::min(FIXED_ACTIVATION_MAX, std::max(v, 0)));
+  }
+};
+
+template <>
+struct ValueTraits<half> {
+  using acc_type = float;
+
+  using real_type = float;
+
+  //throws if v is beyond the largest half
+  static half from_real(const double v) {
+    half h(static_cast<float>(v));
+    if((h.bits & 0x7fff) == 0x7c00 && std::isfinite(v)) {
+      throw std::runtime_error("value " + std::to_string(v) + " exceeds the range of half");
+    }
+    return h;
+  }
+
+  static half from_input(const double v) {
+    return from_real(v);
+  }
+
+  static float bias(const double v) {
+    return static_cast<float>(v);
+  }
+
+  static float mul(const half y, const half w) {
+    return static_cast<float>(y) * static_cast<float>(w);
+  }
+
+  static half activate(const float acc, const size_t) {
+    return half(std::min(32.f, std::max(acc, 0.f)));
+  }
+};
+
+}// end of namespace snig ----------------------------------------------
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace snig {
+
+//IEEE 754 binary16 storage type of host code
+//Values are only stored in 16 bits and are converted to float for arithmetic.
+//Scalar conversions use F16C if the compiler targets it (-mf16c) and bit operations otherwise,
+//SIMD kernels convert 8 or 16 values at once in registers (simd_kernel.hpp).
+//The layout equals half of CUDA, so binary files of both are the same.
+
+inline
+uint16_t float_to_half_bits(const float v);
+
+inline
+float half_bits_to_float(const uint16_t h);
+
+struct half {
+
+  uint16_t bits;
+
+  half() = default;
+
+  half(const float v) : bits{float_to_half_bits(v)} {
+  }
+
+  operator float() const {
+    return half_bits_to_float(bits);
+  }
+};
+
+static_assert(sizeof(half) == 2, "half must be 16 bits");
+
+//-----------------------------------------------------------------------------
+//Definition of half function
+//-----------------------------------------------------------------------------
+
+//rounds to the nearest even value, out of range values become infinity
+inline
+uint16_t float_to_half_bits(const float v) {
+#ifdef __F16C__
+  return _cvtss_sh(v, _MM_FROUND_TO_NEAREST_INT);
+#else
+  uint32_t x;
+  std::memcpy(&x, &v, sizeof(x));
+  uint32_t sign = (x >> 16) & 0x8000;
+  x &= 0x7fffffff;
+
+  //infinity and NaN, or beyond the largest half after rounding
+  if(x >= 0x47800000) {
+    return sign | (x > 0x7f800000 ? 0x7e00 : 0x7c00);
+  }
+
+  //subnormal or zero: adding 0.5 aligns the mantissa to the subnormal step of half,
+  //and the addition itself rounds to nearest even
+  if(x < 0x38800000) {
+    const uint32_t magic_bits = 126 << 23;
+    float magic, f;
+    std::memcpy(&magic, &magic_bits, sizeof(magic));
+    std::memcpy(&f, &x, sizeof(f));
+    f += magic;
+    std::memcpy(&x, &f, sizeof(x));
+    return sign | (x - magic_bits);
+  }
+
+  //rebias the exponent and round the 13 dropped mantissa bits to nearest even
+  uint32_t odd = (x >> 13) & 1;
+  x += 0xc8000fff + odd;
+  return sign | (x >> 13);
+#endif
+}
+
+inline
+float half_bits_to_float(const uint16_t h) {
+#ifdef __F16C__
+  return _cvtsh_ss(h);
+#else
+  uint32_t sign = uint32_t(h & 0x8000) << 16;
+  uint32_t exp = h & 0x7c00;
+  uint32_t x = uint32_t(h & 0x7fff) << 13;
+  float v;
+  if(exp == 0x7c00) {
+    //infinity and NaN
+    x += (255 - 31) << 23;
+  }
+  else if(exp == 0) {
+    //subnormal or zero: the mantissa scaled by 2^-24
+    v = float(h & 0x3ff) * (1.f / 16777216.f);
+    std::memcpy(&x, &v, sizeof(x));
+  }
+  else {
+    x += (127 - 15) << 23;
+  }
+  x |= sign;
+  std::memcpy(&v, &x, sizeof(v));
+  return v;
+#endif
+}
+
+}// end of namespace snig ----------------------------------------------
@@ -0,0 +1,343 @@
+#pragma once
+#include <experimental/filesystem>
+#include <fstream>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <SNIG/utility/sparse_input.hpp>
+#include <SNIG/utility/fixed_point.hpp>
+
+namespace std {
+  namespace fs = experimental::filesystem;
+}
+
+namespace snig {
+
+template <typename T>
+struct InputBatch {
+  size_t beg_inputs {0};
+  size_t num_rows {0};
+  size_t buffer {0};
+  T* Y {nullptr};
+  bool* is_nonzero_row {nullptr};
+};
+
+template <typename T>
+class InputStream {
+
+  //Streams batches of a dense or sparse input file through a ring of batch buffers
+  //A producer thread reads and decodes batch k+1 while batch k is being inferred,
+  //so the memory usage only depends on the batch size and the number of buffers.
+  //Batches are popped in input order, and their buffers are released after inference.
+  //Files store values of ValueTraits<T>::real_type, which are quantized for int16_t.
+
+  public:
+
+    //each buffer holds batch_size rows of Y and is_nonzero_row
+    //buffers are owned by the caller and must start zeroed with all flags false
+    InputStream(
+      const std::fs::path& input_path,
+      const size_t num_inputs,
+      const size_t batch_size,
+      const size_t num_neurons,
+      const size_t sec_size,
+      const size_t num_secs,
+      const std::vector<T*>& Y,
+      const std::vector<bool*>& is_nonzero_row
+    );
+
+    InputStream(const InputStream&) = delete;
+
+    InputStream& operator = (const InputStream&) = delete;
+
+    ~InputStream();
+
+    //blocks until the next batch is staged
+    //returns false after the last batch, rethrows errors of the producer
+    bool pop(InputBatch<T>& batch);
+
+    //gives the buffer of batch back to the producer
+    void release(const InputBatch<T>& batch);
+
+    size_t num_buffers() const;
+
+  private:
+
+    std::fs::path _input_path;
+    std::ifstream _in;
+    bool _sparse;
+    size_t _rows;
+    size_t _nnz;
+
+    size_t _num_inputs;
+    size_t _batch_size;
+    size_t _num_neurons;
+    size_t _sec_size;
+    size_t _num_secs;
+
+    std::vector<T*> _Y;
+    std::vector<bool*> _is_nonzero_row;
+
+    using Real = typename ValueTraits<T>::real_type;
+
+    //staging arrays of a sparse batch
+    //values are converted into _value unless T is Real
+    std::vector<uint64_t> _row_offsets;
+    std::vector<int> _col_index;
+    std::vector<Real> _real_value;
+    std::vector<T> _value;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<size_t> _free;
+    std::deque<InputBatch<T> > _staged;
+    bool _done {false};
+    bool _stop {false};
+    std::exception_ptr _error;
+    std::thread _producer;
+
+    void _open();
+
+    void _produce();
+
+    void _read_batch(const size_t beg_inputs, const size_t num_rows, T* Y, bool* is_nonzero_row);
+};
+
+// ----------------------------------------------------------------------------
+// Definition of InputStream
+// ----------------------------------------------------------------------------
+
+template <typename T>
+InputStream<T>::InputStream(
+  const std::fs::path& input_path,
+  const size_t num_inputs,
+  const size_t batch_size,
+  const size_t num_neurons,
+  const size_t sec_size,
+  const size_t num_secs,
+  const std::vector<T*>& Y,
+  const std::vector<bool*>& is_nonzero_row
+) :
+  _input_path{input_path},
+  _num_inputs{num_inputs},
+  _batch_size{batch_size},
+  _num_neurons{num_neurons},
+  _sec_size{sec_size},
+  _num_secs{num_secs},
+  _Y{Y},
+  _is_nonzero_row{is_nonzero_row}
+{
+  if(_Y.empty() || _Y.size() != _is_nonzero_row.size()) {
+    throw std::runtime_error("input stream needs the same number of Y and is_nonzero_row buffers");
+  }
+
+  _open();
+
+  for(size_t b = 0; b < _Y.size(); ++b) {
+    _free.push_back(b);
+  }
+  _producer = std::thread([this](){ _produce(); });
+}
+
+template <typename T>
+InputStream<T>::~InputStream() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _cv.notify_all();
+  _producer.join();
+}
+
+template <typename T>
+bool InputStream<T>::pop(InputBatch<T>& batch) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _cv.wait(lock, [this](){ return !_staged.empty() || _done; });
+
+  if(!_staged.empty()) {
+    batch = _staged.front();
+    _staged.pop_front();
+    return true;
+  }
+  if(_error) {
+    std::rethrow_exception(_error);
+  }
+  return false;
+}
+
+template <typename T>
+void InputStream<T>::release(const InputBatch<T>& batch) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _free.push_back(batch.buffer);
+  }
+  _cv.notify_all();
+}
+
+template <typename T>
+size_t InputStream<T>::num_buffers() const {
+  return _Y.size();
+}
+
+template <typename T>
+void InputStream<T>::_open() {
+  using namespace std::literals::string_literals;
+
+  _sparse = is_sparse_input(_input_path);
+  _in.open(_input_path, std::ios::in | std::ios::binary);
+  if(!_in) {
+    throw std::runtime_error("cannot open the file"s + _input_path.c_str());
+  }
+
+  size_t cols;
+  if(_sparse) {
+    SparseInputHeader header;
+    _in.read((char*)&header, sizeof(SparseInputHeader));
+    if(header.version != INPUT_VERSION || header.dtype != model_dtype<Real>()) {
+      throw std::runtime_error("sparse input file "s + _input_path.c_str() + " does not match the engine");
+    }
+    _rows = header.rows;
+    cols = header.cols;
+    _nnz = header.nnz;
+  }
+  else {
+    _in.read((char*)&_rows, sizeof(size_t));
+    _in.read((char*)&cols, sizeof(size_t));
+    _nnz = 0;
+  }
+
+  if(!_in || cols != _num_neurons || _rows < _num_inputs) {
+    throw std::runtime_error("input file "s + _input_path.c_str() + " does not match the number of inputs and neurons");
+  }
+}
+
+template <typename T>
+void InputStream<T>::_produce() {
+  try {
+    for(size_t beg_inputs = 0; beg_inputs < _num_inputs; beg_inputs += _batch_size) {
+      size_t b;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this](){ return _stop || !_free.empty(); });
+        if(_stop) {
+          break;
+        }
+        b = _free.front();
+        _free.pop_front();
+      }
+
+      InputBatch<T> batch;
+      batch.beg_inputs = beg_inputs;
+      batch.num_rows = std::min(_batch_size, _num_inputs - beg_inputs);
+      batch.buffer = b;
+      batch.Y = _Y[b];
+      batch.is_nonzero_row = _is_nonzero_row[b];
+      _read_batch(beg_inputs, batch.num_rows, batch.Y, batch.is_nonzero_row);
+
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _staged.push_back(batch);
+      }
+      _cv.notify_all();
+    }
+  }
+  catch(...) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _error = std::current_exception();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _done = true;
+  }
+  _cv.notify_all();
+}
+
+//rows past num_rows of a partial batch are reset,
+//so engines running the whole batch see empty rows
+template <typename T>
+void InputStream<T>::_read_batch(
+  const size_t beg_inputs,
+  const size_t num_rows,
+  T* Y,
+  bool* is_nonzero_row
+) {
+  using namespace std::literals::string_literals;
+
+  if(_sparse) {
+    const size_t col_pos = sizeof(SparseInputHeader) + sizeof(uint64_t) * (_rows + 1);
+    const size_t val_pos = col_pos + sizeof(int) * _nnz;
+
+    _row_offsets.resize(num_rows + 1);
+    _in.seekg(sizeof(SparseInputHeader) + sizeof(uint64_t) * beg_inputs);
+    _in.read((char*)_row_offsets.data(), sizeof(uint64_t) * (num_rows + 1));
+
+    size_t beg = _row_offsets[0];
+    size_t nnz = _row_offsets[num_rows] - beg;
+    _col_index.resize(nnz);
+    _real_value.resize(nnz);
+    _in.seekg(col_pos + sizeof(int) * beg);
+    _in.read((char*)_col_index.data(), sizeof(int) * nnz);
+    _in.seekg(val_pos + sizeof(Real) * beg);
+    _in.read((char*)_real_value.data(), sizeof(Real) * nnz);
+
+    const T* value = reinterpret_cast<const T*>(_real_value.data());
+    if(!std::is_same<T, Real>::value) {
+      _value.resize(nnz);
+      std::transform(_real_value.begin(), _real_value.end(), _value.begin(), [](Real v){ return ValueTraits<T>::from_input(v); });
+      value = _value.data();
+    }
+
+    scatter_sparse_rows(
+      _row_offsets.data(),
+      _col_index.data(),
+      value,
+      num_rows,
+      _num_neurons,
+      Y,
+      is_nonzero_row,
+      _sec_size,
+      _num_secs
+    );
+  }
+  else {
+    //whole rows are overwritten, only the flags are recomputed
+    _in.seekg(2 * sizeof(size_t) + sizeof(Real) * beg_inputs * _num_neurons);
+    if(std::is_same<T, Real>::value) {
+      _in.read((char*)Y, sizeof(T) * num_rows * _num_neurons);
+    }
+    else {
+      _real_value.resize(num_rows * _num_neurons);
+      _in.read((char*)_real_value.data(), sizeof(Real) * num_rows * _num_neurons);
+      std::transform(_real_value.begin(), _real_value.end(), Y, [](Real v){ return ValueTraits<T>::from_input(v); });
+    }
+
+    for(size_t r = 0; r < num_rows; ++r) {
+      for(size_t s = 0; s < _num_secs; ++s) {
+        const T* y = Y + r * _num_neurons + s * _sec_size;
+        is_nonzero_row[r * _num_secs + s] = std::any_of(y, y + _sec_size, [](T v){ return v != T(0); });
+      }
+    }
+  }
+
+  if(!_in) {
+    throw std::runtime_error("cannot read inputs from "s + _input_path.c_str());
+  }
+
+  reset_rows(
+    _batch_size - num_rows,
+    _num_neurons,
+    Y + num_rows * _num_neurons,
+    is_nonzero_row + num_rows * _num_secs,
+    _sec_size,
+    _num_secs
+  );
+}
+
+}// end of namespace snig ----------------------------------------------
@@ -0,0 +1,282 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define SNIG_ENABLE_X86_SIMD
+#endif
+
+namespace snig {
+
+//Compressed layer of the packed CSC weight
+//
+//  [uint64_t nnz][uint64_t num_vals]
+//  [val_w(num_vals)                                        ]
+//  [counts   num_neurons * N_SLAB bit-packed values        ]
+//  [deltas   nnz bit-packed values                         ]
+//
+//counts holds the number of nonzeros of each column (s_o * num_neurons + j),
+//so col_w is their exclusive prefix sum.
+//Rows of each column are sorted, deltas holds the first row relative to
+//the section and then the gap to the previous row.
+//Regular strides of RadiX-Net layers make the gaps small and similar.
+//Both streams are split into blocks of CODEC_BLOCK values,
+//each block is one byte of bit width followed by the packed bits.
+//A layer is stored as uint64_t words, so val_w is aligned.
+
+constexpr size_t CODEC_BLOCK = 128;
+
+//gathers of the decoder read 4 bytes at the byte of a value
+constexpr size_t CODEC_PADDING = sizeof(uint64_t);
+
+template <typename T>
+std::vector<uint64_t> encode_layer(
+  const int* col_w,
+  const uint16_t* short_row_w,
+  const T* val_w,
+  const size_t num_vals,
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB
+);
+
+template <typename T>
+const T* decode_layer(
+  const uint64_t* layer,
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB,
+  int* col_w,
+  uint16_t* short_row_w
+);
+
+inline
+size_t encoded_nnz(const uint64_t* layer);
+
+inline
+size_t encoded_num_vals(const uint64_t* layer);
+
+//-----------------------------------------------------------------------------
+//Definition of layer codec function
+//-----------------------------------------------------------------------------
+
+inline
+size_t encoded_nnz(const uint64_t* layer) {
+  return layer[0];
+}
+
+inline
+size_t encoded_num_vals(const uint64_t* layer) {
+  return layer[1];
+}
+
+//appends one block of at most CODEC_BLOCK values
+inline
+void pack_block(const uint32_t* values, const size_t n, std::vector<uint8_t>& out) {
+  uint32_t max_value = *std::max_element(values, values + n);
+  uint8_t width = 0;
+  while(width < 32 && (max_value >> width) != 0) {
+    ++width;
+  }
+  out.push_back(width);
+
+  uint64_t buffer = 0;
+  size_t num_bits = 0;
+  for(size_t i = 0; i < n; ++i) {
+    buffer |= uint64_t(values[i]) << num_bits;
+    num_bits += width;
+    while(num_bits >= 8) {
+      out.push_back(uint8_t(buffer));
+      buffer >>= 8;
+      num_bits -= 8;
+    }
+  }
+  if(num_bits > 0) {
+    out.push_back(uint8_t(buffer));
+  }
+}
+
+inline
+void pack_stream(const std::vector<uint32_t>& values, std::vector<uint8_t>& out) {
+  for(size_t beg = 0; beg < values.size(); beg += CODEC_BLOCK) {
+    pack_block(values.data() + beg, std::min(CODEC_BLOCK, values.size() - beg), out);
+  }
+}
+
+//value i of width w starts at bit i * w
+//an unaligned 4-byte load at its byte holds it entirely for w <= 25
+inline
+void unpack_bits(const uint8_t* in, const size_t n, const uint32_t width, uint32_t* out) {
+  const uint32_t mask = (uint32_t(1) << width) - 1;
+  for(size_t i = 0; i < n; ++i) {
+    size_t bit = i * width;
+    uint32_t word;
+    std::memcpy(&word, in + (bit >> 3), sizeof(uint32_t));
+    out[i] = (word >> (bit & 7)) & mask;
+  }
+}
+
+#ifdef SNIG_ENABLE_X86_SIMD
+
+//8 values per step: gather the 4-byte words at their bytes and shift each lane by its bit offset
+__attribute__((target("avx2")))
+inline
+void unpack_bits_avx2(const uint8_t* in, const size_t n, const uint32_t width, uint32_t* out) {
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i widths = _mm256_set1_epi32(width);
+  const __m256i mask = _mm256_set1_epi32((uint32_t(1) << width) - 1);
+  const __m256i seven = _mm256_set1_epi32(7);
+  size_t i = 0;
+  for(; i + 8 <= n; i += 8) {
+    __m256i bit = _mm256_mullo_epi32(_mm256_add_epi32(_mm256_set1_epi32(i), lanes), widths);
+    __m256i word = _mm256_i32gather_epi32((const int*)in, _mm256_srli_epi32(bit, 3), 1);
+    word = _mm256_srlv_epi32(word, _mm256_and_si256(bit, seven));
+    _mm256_storeu_si256((__m256i*)(out + i), _mm256_and_si256(word, mask));
+  }
+  if(i < n) {
+    const uint8_t* tail = in + ((i * width) >> 3);
+    unpack_bits(tail, n - i, width, out + i);
+  }
+}
+
+#endif
+
+//decodes one block of n values into out, returns the next block
+//widths never exceed 17 bits (counts are at most MAX_SHORT_SEC_SIZE, gaps fit uint16_t)
+inline
+const uint8_t* unpack_block(const uint8_t* in, const size_t n, uint32_t* out) {
+#ifdef SNIG_ENABLE_X86_SIMD
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+#endif
+  uint32_t width = *in++;
+  if(width == 0) {
+    std::fill(out, out + n, 0);
+    return in;
+  }
+#ifdef SNIG_ENABLE_X86_SIMD
+  if(has_avx2) {
+    unpack_bits_avx2(in, n, width, out);
+  }
+  else {
+    unpack_bits(in, n, width, out);
+  }
+#else
+  unpack_bits(in, n, width, out);
+#endif
+  return in + (n * width + 7) / 8;
+}
+
+template <typename T>
+std::vector<uint64_t> encode_layer(
+  const int* col_w,
+  const uint16_t* short_row_w,
+  const T* val_w,
+  const size_t num_vals,
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB
+) {
+  size_t num_keys = num_neurons_per_layer * N_SLAB;
+  size_t nnz = col_w[num_keys];
+  bool uniform = num_vals < nnz;
+
+  std::vector<uint32_t> counts(num_keys);
+  std::vector<uint32_t> deltas(nnz);
+  std::vector<T> vals(val_w, val_w + num_vals);
+  std::vector<size_t> order;
+
+  for(size_t key = 0; key < num_keys; ++key) {
+    size_t beg = col_w[key];
+    size_t end = col_w[key + 1];
+    counts[key] = end - beg;
+
+    //rows of a column are distinct, so reordering them with their values
+    //does not change the sum accumulated by any row
+    order.resize(end - beg);
+    std::iota(order.begin(), order.end(), beg);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return short_row_w[a] < short_row_w[b];
+    });
+
+    uint32_t prev = 0;
+    for(size_t k = beg; k < end; ++k) {
+      uint32_t row = short_row_w[order[k - beg]];
+      deltas[k] = row - prev;
+      prev = row;
+      if(!uniform) {
+        vals[k] = val_w[order[k - beg]];
+      }
+    }
+  }
+
+  std::vector<uint8_t> bytes;
+  pack_stream(counts, bytes);
+  pack_stream(deltas, bytes);
+
+  size_t val_words = (sizeof(T) * num_vals + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+  size_t byte_words = (bytes.size() + CODEC_PADDING + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+  std::vector<uint64_t> layer(2 + val_words + byte_words, 0);
+  layer[0] = nnz;
+  layer[1] = num_vals;
+  std::memcpy(layer.data() + 2, vals.data(), sizeof(T) * num_vals);
+  std::memcpy(layer.data() + 2 + val_words, bytes.data(), bytes.size());
+  return layer;
+}
+
+//fills col_w(num_neurons * N_SLAB + 1) and short_row_w(nnz)
+//returns val_w, which stays inside the compressed layer
+template <typename T>
+const T* decode_layer(
+  const uint64_t* layer,
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB,
+  int* col_w,
+  uint16_t* short_row_w
+) {
+  size_t num_keys = num_neurons_per_layer * N_SLAB;
+  size_t nnz = encoded_nnz(layer);
+  size_t num_vals = encoded_num_vals(layer);
+  size_t val_words = (sizeof(T) * num_vals + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+  const T* val_w = reinterpret_cast<const T*>(layer + 2);
+  const uint8_t* in = reinterpret_cast<const uint8_t*>(layer + 2 + val_words);
+
+  //decode CODEC_BLOCK values at a time into a buffer that stays in L1
+  uint32_t buffer[CODEC_BLOCK];
+
+  col_w[0] = 0;
+  for(size_t beg = 0; beg < num_keys; beg += CODEC_BLOCK) {
+    size_t len = std::min(CODEC_BLOCK, num_keys - beg);
+    in = unpack_block(in, len, buffer);
+    for(size_t i = 0; i < len; ++i) {
+      col_w[beg + i + 1] = col_w[beg + i] + buffer[i];
+    }
+  }
+  if(size_t(col_w[num_keys]) != nnz) {
+    throw std::runtime_error("corrupted compressed layer");
+  }
+
+  //columns restart their rows from zero
+  //the first entry of each column is flagged in short_row_w,
+  //then rows are accumulated in one linear pass without branches on column ends
+  std::fill(short_row_w, short_row_w + nnz, 0);
+  for(size_t key = 0; key < num_keys; ++key) {
+    if(col_w[key] < col_w[key + 1]) {
+      short_row_w[col_w[key]] = 1;
+    }
+  }
+
+  uint16_t row = 0;
+  for(size_t beg = 0; beg < nnz; beg += CODEC_BLOCK) {
+    size_t len = std::min(CODEC_BLOCK, nnz - beg);
+    in = unpack_block(in, len, buffer);
+    for(size_t i = 0; i < len; ++i) {
+      row = (short_row_w[beg + i] ? 0 : row) + buffer[i];
+      short_row_w[beg + i] = row;
+    }
+  }
+  return val_w;
+}
+
+}// end of namespace snig ----------------------------------------------
@@ -0,0 +1,477 @@
+#pragma once
+#include <experimental/filesystem>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <SNIG/utility/model_format.hpp>
+
+namespace std {
+  namespace fs = experimental::filesystem;
+}
+
+namespace snig {
+
+template <typename T>
+class MappedWeight {
+
+  //Zero-copy view of the binary weight files n{N}-l{i}.b
+  //or of the single-file model container n{N}-model.b
+  //Each file is memory-mapped read-only,
+  //and col_w/row_w/val_w point directly into the mapping.
+  //Row indices keep the width of the files: int for layer files,
+  //int or uint16_t for a container.
+  //Pages are file-backed and clean, so they never add anonymous memory
+  //and can be reclaimed by the kernel under pressure.
+
+  public:
+
+    //weight_path is a container, a directory holding one,
+    //or a directory of layer files partitioned into N_SLAB sections
+    MappedWeight(
+      const std::fs::path& weight_path,
+      const size_t num_neurons_per_layer,
+      const size_t num_layers,
+      const size_t N_SLAB,
+      const size_t readahead_layers = 4
+    );
+
+    ~MappedWeight();
+
+    MappedWeight(const MappedWeight&) = delete;
+
+    MappedWeight& operator = (const MappedWeight&) = delete;
+
+    size_t num_layers() const;
+
+    size_t max_nnz() const;
+
+    //largest number of values stored by a layer
+    size_t max_vals() const;
+
+    //section partition of the weight, given by the container if there is one
+    size_t sec_size() const;
+
+    size_t num_secs() const;
+
+    size_t nnz(const size_t layer) const;
+
+    //a uniform layer stores a single value for all of its nonzeros
+    bool uniform(const size_t layer) const;
+
+    //true if row indices are uint16_t relative to their section (short_row_w)
+    //instead of global int indices (row_w)
+    bool short_index() const;
+
+    const int* col_w(const size_t layer) const;
+
+    const int* row_w(const size_t layer) const;
+
+    const uint16_t* short_row_w(const size_t layer) const;
+
+    const T* val_w(const size_t layer) const;
+
+    //advise the kernel to read ahead layers [layer, layer + readahead_layers)
+    //the window is advised on every call, since pages read by an earlier pass
+    //may have been reclaimed by the time a later batch reaches them
+    //nothing is advised before the first call, which should follow column_readahead
+    void prefetch(const size_t layer);
+
+    //advise the kernel to read the row indices and values of the columns
+    //in the sorted neuron ranges [beg, end) of every section of layer
+    //a batch only reads the columns of its nonzero inputs,
+    //so an out-of-core weight is read by column ranges instead of whole layers
+    void prefetch_columns(
+      const size_t layer,
+      const std::vector<std::pair<size_t, size_t> >& columns
+    ) const;
+
+    //with column readahead, prefetch only advises the column pointers of layers
+    //and leaves their row indices and values to prefetch_columns
+    void column_readahead(const bool enable);
+
+  private:
+
+    struct Layer {
+      //mapping of a layer file, unused with a container
+      void* addr {nullptr};
+      size_t length {0};
+      //bytes of the layer advised to the kernel
+      const char* data {nullptr};
+      size_t size {0};
+      size_t nnz {0};
+      size_t num_vals {0};
+      const int* col_w {nullptr};
+      const int* row_w {nullptr};
+      const uint16_t* short_row_w {nullptr};
+      const T* val_w {nullptr};
+      //values are copied only if the mapping does not satisfy alignof(T)
+      std::unique_ptr<T[]> aligned_val_w;
+    };
+
+    std::vector<Layer> _layers;
+    void* _model_addr {nullptr};
+    size_t _model_length {0};
+    size_t _max_nnz {0};
+    size_t _max_vals {0};
+    bool _short_index {false};
+    size_t _sec_size;
+    size_t _num_secs;
+    size_t _readahead_layers;
+    bool _column_readahead {false};
+
+    void _map_model(
+      const std::fs::path& p,
+      const size_t num_neurons_per_layer
+    );
+
+    void _map_layer(
+      const std::fs::path& p,
+      const size_t num_neurons_per_layer,
+      const size_t N_SLAB,
+      Layer& layer
+    );
+
+    void _set_val_w(const char* val_begin, Layer& layer);
+
+    void _advise(const size_t beg_layer, const size_t end_layer) const;
+
+    void _unmap();
+};
+
+// ----------------------------------------------------------------------------
+// Definition of MappedWeight
+// ----------------------------------------------------------------------------
+
+template <typename T>
+MappedWeight<T>::MappedWeight(
+  const std::fs::path& weight_path,
+  const size_t num_neurons_per_layer,
+  const size_t num_layers,
+  const size_t N_SLAB,
+  const size_t readahead_layers
+) :
+  _layers(num_layers),
+  _sec_size{num_neurons_per_layer / N_SLAB},
+  _num_secs{N_SLAB},
+  _readahead_layers{std::max(readahead_layers, size_t{1})}
+{
+  std::fs::path model_file = find_model_file(weight_path, num_neurons_per_layer);
+  if(!model_file.empty()) {
+    try {
+      _map_model(model_file, num_neurons_per_layer);
+    }
+    catch(...) {
+      _unmap();
+      throw;
+    }
+    return;
+  }
+
+  try {
+    for(size_t i = 0; i < num_layers; ++i) {
+      std::fs::path p = weight_path;
+      p /= "n" + std::to_string(num_neurons_per_layer) + "-l"
+        + std::to_string(i + 1) + ".b";
+      _map_layer(p, num_neurons_per_layer, N_SLAB, _layers[i]);
+      _max_nnz = std::max(_max_nnz, _layers[i].nnz);
+      _max_vals = std::max(_max_vals, _layers[i].num_vals);
+    }
+  }
+  catch(...) {
+    _unmap();
+    throw;
+  }
+}
+
+template <typename T>
+MappedWeight<T>::~MappedWeight() {
+  _unmap();
+}
+
+template <typename T>
+void MappedWeight<T>::_unmap() {
+  for(auto& layer : _layers) {
+    if(layer.addr != nullptr) {
+      ::munmap(layer.addr, layer.length);
+      layer.addr = nullptr;
+    }
+  }
+  if(_model_addr != nullptr) {
+    ::munmap(_model_addr, _model_length);
+    _model_addr = nullptr;
+  }
+}
+
+template <typename T>
+void MappedWeight<T>::_map_model(
+  const std::fs::path& p,
+  const size_t num_neurons_per_layer
+) {
+  using namespace std::literals::string_literals;
+
+  int fd = ::open(p.c_str(), O_RDONLY);
+  if(fd < 0) {
+    throw std::runtime_error("cannot open the file"s + p.c_str());
+  }
+
+  struct stat st;
+  if(::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(ModelHeader))) {
+    ::close(fd);
+    throw std::runtime_error("invalid model file "s + p.c_str());
+  }
+
+  _model_length = st.st_size;
+  _model_addr = ::mmap(nullptr, _model_length, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if(_model_addr == MAP_FAILED) {
+    _model_addr = nullptr;
+    throw std::runtime_error("cannot map the file "s + p.c_str() + " : " + std::strerror(errno));
+  }
+
+  const char* base = static_cast<const char*>(_model_addr);
+  ModelHeader header;
+  std::memcpy(&header, base, sizeof(ModelHeader));
+  check_model_header<T>(header, num_neurons_per_layer, _layers.size(), p);
+  if(_model_length < sizeof(ModelHeader) + sizeof(ModelLayerIndex) * header.num_layers) {
+    throw std::runtime_error("invalid model file "s + p.c_str());
+  }
+
+  _sec_size = header.sec_size;
+  _num_secs = header.num_secs;
+  _short_index = header.row_index_size == sizeof(uint16_t);
+
+  const char* index_begin = base + sizeof(ModelHeader);
+  for(size_t i = 0; i < _layers.size(); ++i) {
+    ModelLayerIndex index;
+    std::memcpy(&index, index_begin + i * sizeof(ModelLayerIndex), sizeof(ModelLayerIndex));
+
+    Layer& layer = _layers[i];
+    layer.nnz = index.nnz;
+    layer.num_vals = index.num_vals;
+    layer.size = model_layer_size<T>(num_neurons_per_layer, _num_secs, layer.nnz, layer.num_vals, header.row_index_size);
+    if(index.offset + layer.size > _model_length) {
+      throw std::runtime_error("layer " + std::to_string(i + 1) + " of "s + p.c_str() + " is truncated");
+    }
+
+    layer.data = base + index.offset;
+    layer.col_w = reinterpret_cast<const int*>(layer.data);
+    if(_short_index) {
+      layer.short_row_w = reinterpret_cast<const uint16_t*>(layer.col_w + num_neurons_per_layer * _num_secs + 1);
+    }
+    else {
+      layer.row_w = layer.col_w + num_neurons_per_layer * _num_secs + 1;
+    }
+    _set_val_w(layer.data + model_val_offset(num_neurons_per_layer, _num_secs, layer.nnz, header.row_index_size), layer);
+    _max_nnz = std::max(_max_nnz, layer.nnz);
+    _max_vals = std::max(_max_vals, layer.num_vals);
+  }
+}
+
+template <typename T>
+void MappedWeight<T>::_map_layer(
+  const std::fs::path& p,
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB,
+  Layer& layer
+) {
+  using namespace std::literals::string_literals;
+
+  int fd = ::open(p.c_str(), O_RDONLY);
+  if(fd < 0) {
+    throw std::runtime_error("cannot open the file"s + p.c_str());
+  }
+
+  struct stat st;
+  if(::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(2 * sizeof(size_t))) {
+    ::close(fd);
+    throw std::runtime_error("invalid weight file "s + p.c_str());
+  }
+
+  layer.length = st.st_size;
+  layer.addr = ::mmap(nullptr, layer.length, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if(layer.addr == MAP_FAILED) {
+    layer.addr = nullptr;
+    throw std::runtime_error("cannot map the file "s + p.c_str() + " : " + std::strerror(errno));
+  }
+
+  //file layout : rows, nnz, col_w(rows * N_SLAB + 1), row_w(nnz), val_w(num_vals)
+  const char* base = static_cast<const char*>(layer.addr);
+  size_t rows;
+  std::memcpy(&rows, base, sizeof(size_t));
+  std::memcpy(&layer.nnz, base + sizeof(size_t), sizeof(size_t));
+
+  size_t index_len = rows * N_SLAB + 1 + layer.nnz;
+  if(rows != num_neurons_per_layer) {
+    throw std::runtime_error("weight file "s + p.c_str() + " does not match the model configuration");
+  }
+  layer.num_vals = weight_file_num_vals<T>(p, layer.length, num_neurons_per_layer, N_SLAB, layer.nnz);
+
+  layer.data = base;
+  layer.size = layer.length;
+  layer.col_w = reinterpret_cast<const int*>(base + 2 * sizeof(size_t));
+  layer.row_w = layer.col_w + rows * N_SLAB + 1;
+  _set_val_w(reinterpret_cast<const char*>(layer.col_w + index_len), layer);
+}
+
+template <typename T>
+void MappedWeight<T>::_set_val_w(const char* val_begin, Layer& layer) {
+  if(reinterpret_cast<uintptr_t>(val_begin) % alignof(T) == 0) {
+    layer.val_w = reinterpret_cast<const T*>(val_begin);
+  }
+  else {
+    layer.aligned_val_w = std::make_unique<T[]>(layer.num_vals);
+    std::memcpy(layer.aligned_val_w.get(), val_begin, sizeof(T) * layer.num_vals);
+    layer.val_w = layer.aligned_val_w.get();
+  }
+}
+
+template <typename T>
+void MappedWeight<T>::prefetch(const size_t layer) {
+  //resident pages make the advice cheap, so only a few calls per layer are spent
+  _advise(std::min(layer, _layers.size()), std::min(layer + _readahead_layers, _layers.size()));
+}
+
+template <typename T>
+void MappedWeight<T>::column_readahead(const bool enable) {
+  _column_readahead = enable;
+}
+
+template <typename T>
+void MappedWeight<T>::_advise(const size_t beg_layer, const size_t end_layer) const {
+  //madvise requires a page-aligned address
+  const uintptr_t page = ::sysconf(_SC_PAGESIZE);
+  const size_t num_neurons = _sec_size * _num_secs;
+  for(size_t i = beg_layer; i < end_layer; ++i) {
+    uintptr_t beg = reinterpret_cast<uintptr_t>(_layers[i].data) / page * page;
+    uintptr_t end = reinterpret_cast<uintptr_t>(_layers[i].data) + _layers[i].size;
+    if(_column_readahead) {
+      end = reinterpret_cast<uintptr_t>(_layers[i].col_w + num_neurons * _num_secs + 1);
+    }
+    ::madvise(reinterpret_cast<void*>(beg), end - beg, MADV_WILLNEED);
+  }
+}
+
+template <typename T>
+void MappedWeight<T>::prefetch_columns(
+  const size_t layer,
+  const std::vector<std::pair<size_t, size_t> >& columns
+) const {
+  const Layer& w = _layers[layer];
+  const size_t num_neurons = _sec_size * _num_secs;
+  const char* row_begin = _short_index ? reinterpret_cast<const char*>(w.short_row_w)
+                                       : reinterpret_cast<const char*>(w.row_w);
+  const size_t row_size = _short_index ? sizeof(uint16_t) : sizeof(int);
+  //copied values are already in memory, a uniform layer stores only one
+  const bool advise_val = !w.aligned_val_w && w.num_vals == w.nnz;
+
+  //byte ranges are widened to pages and merged,
+  //so neighbouring columns and sections cost a single call
+  const uintptr_t page = ::sysconf(_SC_PAGESIZE);
+  std::vector<std::pair<uintptr_t, uintptr_t> > ranges;
+  auto add_range = [&](const char* beg, const char* end) {
+    ranges.emplace_back(
+      reinterpret_cast<uintptr_t>(beg) / page * page,
+      (reinterpret_cast<uintptr_t>(end) + page - 1) / page * page
+    );
+  };
+  for(size_t s_o = 0; s_o < _num_secs; ++s_o) {
+    const int* sec_col_w = w.col_w + s_o * num_neurons;
+    for(const auto& column : columns) {
+      size_t beg_k = sec_col_w[column.first];
+      size_t end_k = sec_col_w[column.second];
+      if(beg_k == end_k) {
+        continue;
+      }
+      add_range(row_begin + beg_k * row_size, row_begin + end_k * row_size);
+      if(advise_val) {
+        add_range(
+          reinterpret_cast<const char*>(w.val_w + beg_k),
+          reinterpret_cast<const char*>(w.val_w + end_k)
+        );
+      }
+    }
+  }
+
+  std::sort(ranges.begin(), ranges.end());
+  for(size_t i = 0; i < ranges.size(); ) {
+    uintptr_t beg = ranges[i].first;
+    uintptr_t end = ranges[i].second;
+    for(++i; i < ranges.size() && ranges[i].first <= end; ++i) {
+      end = std::max(end, ranges[i].second);
+    }
+    ::madvise(reinterpret_cast<void*>(beg), end - beg, MADV_WILLNEED);
+  }
+}
+
+template <typename T>
+size_t MappedWeight<T>::num_layers() const {
+  return _layers.size();
+}
+
+template <typename T>
+size_t MappedWeight<T>::max_nnz() const {
+  return _max_nnz;
+}
+
+template <typename T>
+size_t MappedWeight<T>::max_vals() const {
+  return _max_vals;
+}
+
+template <typename T>
+size_t MappedWeight<T>::sec_size() const {
+  return _sec_size;
+}
+
+template <typename T>
+size_t MappedWeight<T>::num_secs() const {
+  return _num_secs;
+}
+
+template <typename T>
+size_t MappedWeight<T>::nnz(const size_t layer) const {
+  return _layers[layer].nnz;
+}
+
+template <typename T>
+bool MappedWeight<T>::uniform(const size_t layer) const {
+  return _layers[layer].num_vals < _layers[layer].nnz;
+}
+
+template <typename T>
+bool MappedWeight<T>::short_index() const {
+  return _short_index;
+}
+
+template <typename T>
+const int* MappedWeight<T>::col_w(const size_t layer) const {
+  return _layers[layer].col_w;
+}
+
+template <typename T>
+const int* MappedWeight<T>::row_w(const size_t layer) const {
+  return _layers[layer].row_w;
+}
+
+template <typename T>
+const uint16_t* MappedWeight<T>::short_row_w(const size_t layer) const {
+  return _layers[layer].short_row_w;
+}
+
+template <typename T>
+const T* MappedWeight<T>::val_w(const size_t layer) const {
+  return _layers[layer].val_w;
+}
+
+}// end of namespace snig ----------------------------------------------
@@ -0,0 +1,602 @@
+#pragma once
+#include <experimental/filesystem>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+#include <mutex>
+#include <SNIG/utility/config.hpp>
+
+namespace std {
+  namespace fs = experimental::filesystem;
+}
+
+namespace snig {
+
+//Single-file model container n{N}-model.b
+//
+//  [ModelHeader            64 bytes                         ]
+//  [ModelLayerIndex        16 bytes * num_layers            ]
+//  [layer blob 1           64-byte aligned                  ]
+//  ...
+//  [layer blob num_layers  64-byte aligned                  ]
+//
+//Each layer blob has the layout of n{N}-l{i}.b without the rows/nnz header:
+//  col_w(num_neurons * num_secs + 1), row_w(nnz), zero padding, val_w(num_vals)
+//where val_w starts at a 64-byte aligned offset of the blob.
+//
+//A layer whose nonzeros all have the same value is uniform:
+//it stores that value once (num_vals = 1) instead of nnz values.
+//
+//row_w holds row_index_size bytes per nonzero:
+//4 for global int indices, 2 for uint16_t indices relative to the output section.
+//
+//Readers accept MODEL_VERSION only.
+//
+//dtype is 1 for float, 2 for double, 3 for half, and 4 for Q8.7 int16_t.
+
+constexpr char MODEL_MAGIC[8] = {'S', 'N', 'I', 'G', 'M', 'D', 'L', '\0'};
+constexpr uint32_t MODEL_VERSION = 1;
+constexpr size_t MODEL_ALIGNMENT = 64;
+
+//sections of at most MAX_SHORT_SEC_SIZE neurons can use uint16_t row indices
+constexpr size_t MAX_SHORT_SEC_SIZE = 65536;
+
+struct ModelHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t dtype;
+  uint64_t num_neurons;
+  uint64_t num_layers;
+  uint64_t sec_size;
+  uint64_t num_secs;
+  uint64_t max_nnz;
+  uint32_t row_index_size;
+  uint32_t reserved;
+};
+
+struct ModelLayerIndex {
+  uint64_t offset;
+  uint32_t nnz;
+  uint32_t num_vals;
+};
+
+static_assert(sizeof(ModelHeader) == 64, "model header must be 64 bytes");
+static_assert(sizeof(ModelLayerIndex) == 16, "model layer index must be 16 bytes");
+
+template <typename T>
+constexpr uint32_t model_dtype();
+
+inline
+size_t model_align(const size_t bytes);
+
+inline
+std::string model_file_name(const size_t num_neurons_per_layer);
+
+template <typename T>
+std::fs::path binary_weight_dir(const std::fs::path& weight_dir);
+
+inline
+std::fs::path find_model_file(
+  const std::fs::path& weight_path,
+  const size_t num_neurons_per_layer
+);
+
+inline
+bool fits_short_row_index(const size_t sec_size);
+
+inline
+size_t row_index_len(const size_t nnz, const bool short_index);
+
+template <typename T>
+size_t packed_val_len(const size_t num_vals);
+
+inline
+void to_short_row_index(
+  const int* col_w,
+  const int* row_w,
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB,
+  uint16_t* short_row_w
+);
+
+inline
+size_t model_val_offset(
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB,
+  const size_t nnz,
+  const size_t row_index_size
+);
+
+template <typename T>
+size_t model_layer_size(
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB,
+  const size_t nnz,
+  const size_t num_vals,
+  const size_t row_index_size
+);
+
+template <typename T>
+size_t num_stored_vals(const T* val_w, const size_t nnz);
+
+template <typename T>
+size_t weight_file_num_vals(
+  const std::fs::path& weight_file,
+  const size_t file_size,
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB,
+  const size_t nnz
+);
+
+template <typename T>
+void write_weight_file(
+  const std::fs::path& weight_file,
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB,
+  const int* col_w,
+  const int* row_w,
+  const T* val_w,
+  const size_t nnz
+);
+
+template <typename T>
+void check_model_header(
+  const ModelHeader& header,
+  const size_t num_neurons_per_layer,
+  const size_t num_layers,
+  const std::fs::path& model_path
+);
+
+inline
+ModelHeader read_model_header(
+  std::istream& in,
+  std::vector<ModelLayerIndex>& index
+);
+
+template <typename T>
+void read_model_binary(
+  std::istream& in,
+  const ModelHeader& header,
+  const std::vector<ModelLayerIndex>& index,
+  const size_t num_neurons_per_layer,
+  const size_t max_nnz_per_layer,
+  const size_t max_vals_per_layer,
+  const size_t num_layers,
+  const size_t N_SLAB,
+  const size_t pad,
+  const bool short_index,
+  int* arr
+);
+
+template <typename T>
+class ModelWriter {
+
+  //Appends layer blobs in any order and records their offsets
+  //write_layer can be called concurrently
+  //The header and the layer index are written by close()
+
+  public:
+
+    ModelWriter(
+      const std::fs::path& model_path,
+      const size_t num_neurons_per_layer,
+      const size_t num_layers,
+      const size_t COL_BLK,
+      const size_t N_SLAB
+    );
+
+    ModelWriter(const ModelWriter&) = delete;
+
+    ModelWriter& operator = (const ModelWriter&) = delete;
+
+    void write_layer(
+      const size_t layer,
+      const int* col_w,
+      const int* row_w,
+      const T* val_w,
+      const size_t nnz
+    );
+
+    void close();
+
+  private:
+
+    std::fs::path _model_path;
+    std::ofstream _out;
+    ModelHeader _header;
+    std::vector<ModelLayerIndex> _index;
+    size_t _end;
+    std::mutex _mutex;
+    std::vector<uint16_t> _short_row_w;
+
+    void _write_zeros(const size_t bytes);
+};
+
+//-----------------------------------------------------------------------------
+//Definition of model format function
+//-----------------------------------------------------------------------------
+
+template <typename T>
+constexpr uint32_t model_dtype() {
+  return std::is_same<T, float>::value  ? 1 :
+         std::is_same<T, double>::value ? 2 :
+         std::is_same<T, half>::value   ? 3 :
+         std::is_same<T, int16_t>::value ? 4 : 0;
+}
+
+inline
+size_t model_align(const size_t bytes) {
+  return (bytes + MODEL_ALIGNMENT - 1) / MODEL_ALIGNMENT * MODEL_ALIGNMENT;
+}
+
+inline
+std::string model_file_name(const size_t num_neurons_per_layer) {
+  return "n" + std::to_string(num_neurons_per_layer) + "-model.b";
+}
+
+//16-bit weights are converted into a subdirectory (int16 or half) of the text weights,
+//so that they never overwrite the float weights
+//a model file given directly is looked up in the subdirectory next to it
+template <typename T>
+std::fs::path binary_weight_dir(const std::fs::path& weight_dir) {
+  const char* sub_dir = std::is_same<T, int16_t>::value ? "int16" :
+                        std::is_same<T, half>::value    ? "half"  : nullptr;
+  if(sub_dir == nullptr) {
+    return weight_dir;
+  }
+  if(std::fs::is_regular_file(weight_dir)) {
+    return weight_dir.parent_path() / sub_dir / weight_dir.filename();
+  }
+  return weight_dir / sub_dir;
+}
+
+//weight_path is either the container itself or a directory holding it
+//returns an empty path if there is no container
+inline
+std::fs::path find_model_file(
+  const std::fs::path& weight_path,
+  const size_t num_neurons_per_layer
+) {
+  if(std::fs::is_regular_file(weight_path)) {
+    return weight_path;
+  }
+  std::fs::path p = weight_path;
+  p /= model_file_name(num_neurons_per_layer);
+  if(std::fs::is_regular_file(p)) {
+    return p;
+  }
+  return std::fs::path{};
+}
+
+inline
+bool fits_short_row_index(const size_t sec_size) {
+  return sec_size <= MAX_SHORT_SEC_SIZE;
+}
+
+//number of int slots taken by nnz row indices in the packed weight
+inline
+size_t row_index_len(const size_t nnz, const bool short_index) {
+  return short_index ? (nnz + 1) / 2 : nnz;
+}
+
+//number of int slots taken by num_vals values in the packed weight
+template <typename T>
+size_t packed_val_len(const size_t num_vals) {
+  return (sizeof(T) * num_vals + sizeof(int) - 1) / sizeof(int);
+}
+
+//nonzeros of output section s_o are [col_w[s_o * num_neurons], col_w[(s_o + 1) * num_neurons])
+//so the global row index of each of them is rebased on its section
+inline
+void to_short_row_index(
+  const int* col_w,
+  const int* row_w,
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB,
+  uint16_t* short_row_w
+) {
+  size_t sec_size = num_neurons_per_layer / N_SLAB;
+  for(size_t s_o = 0; s_o < N_SLAB; ++s_o) {
+    int sec_offset = s_o * sec_size;
+    for(int k = col_w[s_o * num_neurons_per_layer]; k < col_w[(s_o + 1) * num_neurons_per_layer]; ++k) {
+      short_row_w[k] = static_cast<uint16_t>(row_w[k] - sec_offset);
+    }
+  }
+}
+
+inline
+size_t model_val_offset(
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB,
+  const size_t nnz,
+  const size_t row_index_size
+) {
+  return model_align(sizeof(int) * (num_neurons_per_layer * N_SLAB + 1) + row_index_size * nnz);
+}
+
+template <typename T>
+size_t model_layer_size(
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB,
+  const size_t nnz,
+  const size_t num_vals,
+  const size_t row_index_size
+) {
+  return model_val_offset(num_neurons_per_layer, N_SLAB, nnz, row_index_size) + sizeof(T) * num_vals;
+}
+
+//number of values a layer needs to store, 1 if the layer is uniform
+template <typename T>
+size_t num_stored_vals(const T* val_w, const size_t nnz) {
+  if(nnz > 1 && std::all_of(val_w + 1, val_w + nnz, [&](const T& v){ return v == val_w[0]; })) {
+    return 1;
+  }
+  return nnz;
+}
+
+//layer file : rows, nnz, col_w(rows * N_SLAB + 1), row_w(nnz), val_w(num_vals)
+//the number of stored values is given by the size of the file
+template <typename T>
+size_t weight_file_num_vals(
+  const std::fs::path& weight_file,
+  const size_t file_size,
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB,
+  const size_t nnz
+) {
+  using namespace std::literals::string_literals;
+
+  size_t index_size = 2 * sizeof(size_t) + sizeof(int) * (num_neurons_per_layer * N_SLAB + 1 + nnz);
+  if(file_size == index_size + sizeof(T) * nnz) {
+    return nnz;
+  }
+  if(nnz > 0 && file_size == index_size + sizeof(T)) {
+    return 1;
+  }
+  throw std::runtime_error("weight file "s + weight_file.c_str() + " does not match the model configuration");
+}
+
+template <typename T>
+void write_weight_file(
+  const std::fs::path& weight_file,
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB,
+  const int* col_w,
+  const int* row_w,
+  const T* val_w,
+  const size_t nnz
+) {
+  using namespace std::literals::string_literals;
+
+  std::ofstream out(weight_file, std::ios::out | std::ios::binary);
+  if(!out) {
+    throw std::runtime_error("cannot open the file"s + weight_file.c_str());
+  }
+  out.write((char*)&num_neurons_per_layer, sizeof(size_t));
+  out.write((char*)&nnz, sizeof(size_t));
+  out.write((char*)col_w, sizeof(int) * (num_neurons_per_layer * N_SLAB + 1));
+  out.write((char*)row_w, sizeof(int) * nnz);
+  out.write((char*)val_w, sizeof(T) * num_stored_vals(val_w, nnz));
+}
+
+template <typename T>
+void check_model_header(
+  const ModelHeader& header,
+  const size_t num_neurons_per_layer,
+  const size_t num_layers,
+  const std::fs::path& model_path
+) {
+  using namespace std::literals::string_literals;
+
+  if(std::memcmp(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0) {
+    throw std::runtime_error("not a model file "s + model_path.c_str());
+  }
+  if(header.version != MODEL_VERSION) {
+    throw std::runtime_error("unsupported model version in "s + model_path.c_str());
+  }
+  if(header.dtype != model_dtype<T>()) {
+    throw std::runtime_error("data type of "s + model_path.c_str() + " does not match the engine");
+  }
+  if(
+    header.num_neurons != num_neurons_per_layer ||
+    header.num_layers < num_layers ||
+    header.num_secs == 0 ||
+    header.sec_size * header.num_secs != header.num_neurons
+  ) {
+    throw std::runtime_error("model file "s + model_path.c_str() + " does not match the model configuration");
+  }
+  if(
+    header.row_index_size != sizeof(int) &&
+    (header.row_index_size != sizeof(uint16_t) || !fits_short_row_index(header.sec_size))
+  ) {
+    throw std::runtime_error("invalid row index size in "s + model_path.c_str());
+  }
+}
+
+inline
+ModelHeader read_model_header(
+  std::istream& in,
+  std::vector<ModelLayerIndex>& index
+) {
+  ModelHeader header;
+  in.read((char*)&header, sizeof(ModelHeader));
+  if(!in) {
+    throw std::runtime_error("cannot read the model header");
+  }
+
+  index.resize(header.num_layers);
+  in.read((char*)index.data(), sizeof(ModelLayerIndex) * header.num_layers);
+  if(!in) {
+    throw std::runtime_error("cannot read the model layer index");
+  }
+  return header;
+}
+
+//reads the first num_layers blobs into the packed layout of read_weight_binary
+//values of a layer take max_vals_per_layer slots
+//int row indices are converted if short_index is set
+//blobs are visited in file order, so the stream only moves forward
+template <typename T>
+void read_model_binary(
+  std::istream& in,
+  const ModelHeader& header,
+  const std::vector<ModelLayerIndex>& index,
+  const size_t num_neurons_per_layer,
+  const size_t max_nnz_per_layer,
+  const size_t max_vals_per_layer,
+  const size_t num_layers,
+  const size_t N_SLAB,
+  const size_t pad,
+  const bool short_index,
+  int* arr
+) {
+  if(header.row_index_size == sizeof(uint16_t) && !short_index) {
+    throw std::runtime_error("the model stores 16-bit row indices but the engine expects int");
+  }
+
+  size_t num_index = num_neurons_per_layer * N_SLAB + 1;
+  size_t p_w_index_len = num_index + row_index_len(max_nnz_per_layer, short_index);
+  size_t pp_wlen = p_w_index_len + pad + packed_val_len<T>(max_vals_per_layer);
+  std::vector<int> row_w;
+
+  std::vector<size_t> order(num_layers);
+  for(size_t i = 0; i < num_layers; ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return index[a].offset < index[b].offset;
+  });
+
+  for(auto i : order) {
+    int* location = arr + i * pp_wlen;
+    size_t nnz = index[i].nnz;
+
+    in.seekg(index[i].offset);
+    in.read((char*)location, sizeof(int) * num_index);
+    if(header.row_index_size == sizeof(int) && short_index) {
+      row_w.resize(nnz);
+      in.read((char*)row_w.data(), sizeof(int) * nnz);
+      to_short_row_index(location, row_w.data(), num_neurons_per_layer, N_SLAB, (uint16_t*)(location + num_index));
+    }
+    else {
+      in.read((char*)(location + num_index), header.row_index_size * nnz);
+    }
+    in.seekg(index[i].offset + model_val_offset(num_neurons_per_layer, N_SLAB, nnz, header.row_index_size));
+    in.read((char*)(location + p_w_index_len), sizeof(T) * index[i].num_vals);
+    if(!in) {
+      throw std::runtime_error("cannot read layer " + std::to_string(i + 1) + " of the model");
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Definition of ModelWriter
+// ----------------------------------------------------------------------------
+
+template <typename T>
+ModelWriter<T>::ModelWriter(
+  const std::fs::path& model_path,
+  const size_t num_neurons_per_layer,
+  const size_t num_layers,
+  const size_t COL_BLK,
+  const size_t N_SLAB
+) :
+  _model_path{model_path},
+  _out{model_path, std::ios::out | std::ios::binary},
+  _index(num_layers, ModelLayerIndex{})
+{
+  using namespace std::literals::string_literals;
+
+  static_assert(model_dtype<T>() != 0, "data type must be either float, double, half, or int16_t");
+
+  if(!_out) {
+    throw std::runtime_error("cannot open the file"s + model_path.c_str());
+  }
+
+  std::memset(&_header, 0, sizeof(ModelHeader));
+  std::memcpy(_header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+  _header.version = MODEL_VERSION;
+  _header.dtype = model_dtype<T>();
+  _header.num_neurons = num_neurons_per_layer;
+  _header.num_layers = num_layers;
+  _header.sec_size = COL_BLK;
+  _header.num_secs = N_SLAB;
+  _header.row_index_size = fits_short_row_index(COL_BLK) ? sizeof(uint16_t) : sizeof(int);
+
+  //reserve the header and the index, they are filled by close()
+  _end = 0;
+  _write_zeros(model_align(sizeof(ModelHeader) + sizeof(ModelLayerIndex) * num_layers));
+}
+
+template <typename T>
+void ModelWriter<T>::write_layer(
+  const size_t layer,
+  const int* col_w,
+  const int* row_w,
+  const T* val_w,
+  const size_t nnz
+) {
+  size_t num_index = _header.num_neurons * _header.num_secs + 1;
+  size_t val_offset = model_val_offset(_header.num_neurons, _header.num_secs, nnz, _header.row_index_size);
+  size_t num_vals = num_stored_vals(val_w, nnz);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  const char* rows = (const char*)row_w;
+  if(_header.row_index_size == sizeof(uint16_t)) {
+    _short_row_w.resize(nnz);
+    to_short_row_index(col_w, row_w, _header.num_neurons, _header.num_secs, _short_row_w.data());
+    rows = (const char*)_short_row_w.data();
+  }
+  _index[layer].offset = _end;
+  _index[layer].nnz = nnz;
+  _index[layer].num_vals = num_vals;
+  _header.max_nnz = std::max<uint64_t>(_header.max_nnz, nnz);
+
+  size_t beg = _end;
+  _out.write((char*)col_w, sizeof(int) * num_index);
+  _out.write(rows, _header.row_index_size * nnz);
+  _end += sizeof(int) * num_index + _header.row_index_size * nnz;
+  _write_zeros(beg + val_offset - _end);
+  _out.write((char*)val_w, sizeof(T) * num_vals);
+  _end += sizeof(T) * num_vals;
+  _write_zeros(model_align(_end) - _end);
+}
+
+template <typename T>
+void ModelWriter<T>::close() {
+  using namespace std::literals::string_literals;
+
+  for(size_t i = 0; i < _index.size(); ++i) {
+    if(_index[i].offset == 0) {
+      throw std::runtime_error("layer " + std::to_string(i + 1) + " is missing in "s + _model_path.c_str());
+    }
+  }
+
+  _out.seekp(0);
+  _out.write((char*)&_header, sizeof(ModelHeader));
+  _out.write((char*)_index.data(), sizeof(ModelLayerIndex) * _index.size());
+  _out.close();
+
+  if(_out.fail()) {
+    throw std::runtime_error("cannot write the file"s + _model_path.c_str());
+  }
+}
+
+template <typename T>
+void ModelWriter<T>::_write_zeros(const size_t bytes) {
+  static const char zeros[MODEL_ALIGNMENT] = {};
+  size_t remain = bytes;
+  while(remain > 0) {
+    size_t n = std::min(remain, MODEL_ALIGNMENT);
+    _out.write(zeros, n);
+    remain -= n;
+  }
+  _end += bytes;
+}
+
+}// end of namespace snig ----------------------------------------------
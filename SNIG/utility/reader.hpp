@@ -8,8 +8,18 @@
 #include <Eigen/Dense>
 #include <vector>
 #include <string>
+#include <memory>
+#include <chrono>
+#include <exception>
+#include <SNIG/utility/config.hpp>
 #include <SNIG/utility/matrix_format.h>
 #include <SNIG/utility/matrix_operation.hpp>
+#include <SNIG/utility/model_format.hpp>
+#include <SNIG/utility/fixed_point.hpp>
+#include <SNIG/utility/tsv_parser.hpp>
+#include <SNIG/utility/csr_builder.hpp>
+#include <SNIG/utility/sparse_input.hpp>
+#include <taskflow/taskflow.hpp>
 
 namespace std {
   namespace fs = experimental::filesystem;
@@ -29,10 +39,17 @@ to_numeric(const std::string& str) {
   return std::stod(str);
 }
 
+//int16_t values are quantized to Q8.7 fixed point
+template <typename T>
+std::enable_if_t<std::is_same<T, int16_t>::value, int16_t> 
+to_numeric(const std::string& str) {
+  return ValueTraits<int16_t>::from_real(std::stod(str));
+}
+
 template <typename T>
 std::enable_if_t<std::is_same<T, half>::value, half> 
 to_numeric(const std::string& str) {
-  return __float2half(std::stof(str));
+  return ValueTraits<half>::from_real(std::stod(str));
 }
 
 template <typename T>
@@ -111,9 +128,11 @@ void read_weight_binary(
   const std::fs::path& weight_dir,
   const size_t num_neurons_per_layer,
   const size_t max_nnz_per_layer,
+  const size_t max_vals_per_layer,
   const size_t num_layers,
   const size_t N_SLAB,
   const size_t pad,
+  const bool short_index,
   int* arr
 );
 
@@ -160,6 +179,14 @@ void read_input(
   T* arr
 );
 
+template <typename T>
+void read_input_values(
+  const std::fs::path& input_path,
+  T* arr,
+  size_t& num_inputs,
+  size_t& num_features
+);
+
 template <typename T>
 void read_input_binary(
   const std::fs::path& input_path,
@@ -183,6 +210,9 @@ void read_input_binary(
   bool* rowsY
 );
 
+inline
+size_t read_num_inputs(const std::fs::path& input_path);
+
 inline
 Eigen::Matrix<int, Eigen::Dynamic, 1> read_golden(
   const std::fs::path& golden_path,
@@ -220,25 +250,52 @@ size_t find_max_nnz_binary(
   const size_t num_neurons_per_layer
 );
 
+template <typename T>
+void find_layer_sizes_binary(
+  const std::fs::path& weight_dir,
+  const size_t num_layers,
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB,
+  std::vector<size_t>& nnz,
+  std::vector<size_t>& num_vals
+);
+
 inline
 size_t count_nnz(const std::string& s);
 
 template <typename T>
-void tsv_file_to_binary_file(
+TSVStats tsv_layer_to_binary_file(
+  const std::fs::path& weight_dir,
+  const size_t layer,
+  const size_t rows,
+  const size_t cols,
+  const size_t COL_BLK,
+  const size_t N_SLAB,
+  CSRBuilder<T>& builder,
+  ModelWriter<T>* writer
+);
+
+template <typename T>
+TSVStats tsv_file_to_binary_file(
   const std::fs::path& weight_dir,
   const size_t num_layers,
   const size_t rows,
   const size_t cols,
   const size_t COL_BLK,
   const size_t N_SLAB,
-  const size_t estimate_nnz
+  const size_t estimate_nnz,
+  const bool consolidate = false,
+  const size_t num_threads = tsv_num_threads(),
+  const size_t max_layers_in_flight = 8
 );
 
 template <typename T>
-void tsv_file_to_binary_file(
+TSVStats tsv_file_to_binary_file(
   std::fs::path file_path,
   const size_t rows,
-  const size_t cols
+  const size_t cols,
+  const size_t num_threads = tsv_num_threads(),
+  const bool dense = false
 );
 
 void tsv_file_to_binary_file(
@@ -291,25 +348,17 @@ Eigen::SparseMatrix<T> tsv_string_to_matrix(
   );
 
   typedef Eigen::Triplet<T> E;
-  std::string line;
-  std::vector<E> triplet_list;
-  triplet_list.reserve(nnz);
-  std::istringstream read_s(s);
-  std::vector<std::string> tokens;
-
-  while(std::getline(read_s, line)){
-    std::istringstream lineStream(line);
-    std::string token;
-    tokens.clear();
-    while(std::getline(lineStream, token, '\t')) {
-      tokens.push_back(std::move(token));
+  size_t num_threads = tsv_num_threads();
+  std::vector<std::vector<E> > parts(num_threads);
+  parts[0].reserve(nnz);
+
+  parallel_parse_tsv<T>(
+    s.data(), s.data() + s.size(), num_threads,
+    [&](size_t w, int row, int col, T value) {
+      parts[w].emplace_back(row - 1, col - 1, value);
     }
-    triplet_list.emplace_back(
-      std::stoi(tokens[0]) - 1,
-      std::stoi(tokens[1]) - 1,
-      to_numeric<T>(tokens[2])
-    );
-  }
+  );
+  std::vector<E> triplet_list = concat_tsv_parts(parts);
 
   Eigen::SparseMatrix<T> mat(rows, cols);
   mat.reserve(triplet_list.size());
@@ -366,21 +415,13 @@ void tsv_string_to_1D_array(
     "data type must be either float or double"
   );
 
-  std::string line;
-  std::istringstream read_s(s);
-
-  std::vector<std::string> tokens;
-
-  while(std::getline(read_s, line)) {
-    std::istringstream lineStream(line);
-    std::string token;
-    tokens.clear();
-    while(std::getline(lineStream, token, '\t')) {
-      tokens.push_back(std::move(token));
+  //each line owns a distinct element, so workers write arr directly
+  parallel_parse_tsv<T>(
+    s.data(), s.data() + s.size(), tsv_num_threads(),
+    [&](size_t, int row, int col, T value) {
+      arr[(row - 1) * cols + col - 1] = value;
     }
-    arr[(std::stoi(tokens[0]) - 1) * cols + std::stoi(tokens[1]) - 1] = to_numeric<T>(tokens[2]);
-  }
-
+  );
 }
 
 template <typename T>
@@ -398,37 +439,32 @@ void tsv_string_to_CSR_packed_array(
     std::is_same<T, float>::value || std::is_same<T, double>::value,
     "data type must be either float or double"
   );
-  typedef Eigen::Triplet<T> E;
-  std::string line;
-  std::vector<E> triplet_list;
-  triplet_list.reserve(nnz);
-  std::istringstream read_s(s);
-  std::vector<std::string> tokens;
+  CSRBuilder<T> builder(rows * N_SLAB, tsv_num_threads());
 
-  while(std::getline(read_s, line)) {
-    std::istringstream lineStream(line);
-    std::string token;
-    tokens.clear();
-    while(std::getline(lineStream, token, '\t')) {
-      tokens.push_back(std::move(token));
+  parallel_parse_tsv<T>(
+    s.data(), s.data() + s.size(), builder.num_workers(),
+    [&](size_t w, int row, int col, T) {
+      builder.count(w, row - 1 + rows * ((col - 1) / COL_BLK));
     }
-    triplet_list.emplace_back(
-      std::stoi(tokens[0]) - 1 + 
-      rows * ((std::stoi(tokens[1]) - 1) / COL_BLK),
-      std::stoi(tokens[1]) - 1,
-      to_numeric<T>(tokens[2])
-    );
-  }
-
-  Eigen::SparseMatrix<T, Eigen::RowMajor> eigen_mat(rows * N_SLAB, cols);
-  eigen_mat.reserve(triplet_list.size());
-  eigen_mat.setFromTriplets(triplet_list.begin(), triplet_list.end());
+  );
 
-  std::copy(eigen_mat.outerIndexPtr(), eigen_mat.outerIndexPtr() + rows * N_SLAB + 1, arr);
-  std::copy(eigen_mat.innerIndexPtr(), eigen_mat.innerIndexPtr() + nnz, arr + rows * N_SLAB + 1);
+  //nnz is the capacity reserved for indices, values start right after it
+  if(builder.nnz() > nnz) {
+    throw std::runtime_error("number of nonzeros exceeds the packed array");
+  }
+  builder.start(
+    arr,
+    arr + rows * N_SLAB + 1,
+    reinterpret_cast<T*>(arr + rows * N_SLAB + 1 + nnz)
+  );
 
-  T* tmp = reinterpret_cast<T*>(arr + rows * N_SLAB + 1 + nnz);
-  std::copy(eigen_mat.valuePtr(), eigen_mat.valuePtr() + nnz, tmp);
+  parallel_parse_tsv<T>(
+    s.data(), s.data() + s.size(), builder.num_workers(),
+    [&](size_t w, int row, int col, T value) {
+      builder.fill(w, row - 1 + rows * ((col - 1) / COL_BLK), col - 1, value);
+    }
+  );
+  builder.finish();
 }
 
 template <typename T>
@@ -511,29 +547,32 @@ void read_weight(
   }
 }
 
+//values of a layer take max_vals_per_layer slots
+//a uniform layer only fills the first one
+//if short_index is set, row indices are stored as uint16_t relative to their section
 template <typename T>
 void read_weight_binary(
   const std::fs::path& weight_dir,
   const size_t num_neurons_per_layer,
   const size_t max_nnz_per_layer,
+  const size_t max_vals_per_layer,
   const size_t num_layers,
   const size_t N_SLAB,
   const size_t pad,
+  const bool short_index,
   int* arr
 ) {
-  //T is either float,double, or double type
+  //T is either float, double, half, or int16_t type
   static_assert(
-    std::is_same<T, float>::value || std::is_same<T, double>::value || std::is_same<T, half>::value,
-    "data type must be either float, double, or half"
+    std::is_same<T, float>::value || std::is_same<T, double>::value || std::is_same<T, half>::value || std::is_same<T, int16_t>::value,
+    "data type must be either float, double, half, or int16_t"
   );
 
-  size_t _pp_wlen{0};
-  if(std::is_same<T, half>::value) {
-    _pp_wlen = num_neurons_per_layer * N_SLAB + 1 + max_nnz_per_layer + int(0.5 * max_nnz_per_layer) + pad;
-  }
-  else {
-    _pp_wlen = num_neurons_per_layer * N_SLAB + 1 + max_nnz_per_layer + (sizeof(T) / sizeof(int)) * max_nnz_per_layer + pad;
-  }
+  size_t num_index = num_neurons_per_layer * N_SLAB + 1;
+  size_t p_w_index_len = num_index + row_index_len(max_nnz_per_layer, short_index);
+  size_t _pp_wlen = p_w_index_len + packed_val_len<T>(max_vals_per_layer) + pad;
+
+  std::vector<int> row_w;
 
   for(size_t i = 0; i < num_layers; ++i) {
     std::fs::path p = weight_dir;
@@ -547,7 +586,18 @@ void read_weight_binary(
 
     in.read((char*)&rows, sizeof(size_t));
     in.read((char*)&nnz, sizeof(size_t));
-    in.read((char*)location, sizeof(int) * (rows * N_SLAB + 1 + nnz) + sizeof(T) * nnz);
+    size_t num_vals = weight_file_num_vals<T>(p, std::fs::file_size(p), num_neurons_per_layer, N_SLAB, nnz);
+    if(short_index) {
+      row_w.resize(nnz);
+      in.read((char*)location, sizeof(int) * num_index);
+      in.read((char*)row_w.data(), sizeof(int) * nnz);
+      to_short_row_index(location, row_w.data(), num_neurons_per_layer, N_SLAB, (uint16_t*)(location + num_index));
+    }
+    else {
+      in.read((char*)location, sizeof(int) * (num_index + nnz));
+    }
+    //values always start after max_nnz indices, even if this layer has fewer
+    in.read((char*)(location + p_w_index_len), sizeof(T) * num_vals);
   }
 }
 
@@ -638,6 +688,29 @@ void read_input(
 }
 
 
+//reads all inputs of a dense or sparse input file into arr
+//sparse input files are densified
+template <typename T>
+void read_input_values(
+  const std::fs::path& input_path,
+  T* arr,
+  size_t& num_inputs,
+  size_t& num_features
+) {
+  if(is_sparse_input(input_path)) {
+    SparseInput<T> input(input_path);
+    num_inputs = input.rows();
+    num_features = input.cols();
+    input.densify(arr);
+    return;
+  }
+
+  std::ifstream in(input_path, std::ios::in | std::ios::binary);
+  in.read((char*)&num_inputs, sizeof(size_t));
+  in.read((char*)&num_features, sizeof(size_t));
+  in.read((char*)arr, sizeof(T) * num_inputs * num_features);
+}
+
 template <typename T>
 void read_input_binary(
   const std::fs::path& input_path,
@@ -652,13 +725,9 @@ void read_input_binary(
     "data type must be either float, double, or half"
   );
 
-  std::fs::path p = input_path;
-  std::ifstream in(p, std::ios::in | std::ios::binary);
   size_t num_inputs;
   size_t num_features;
-  in.read((char*)&num_inputs, sizeof(size_t));
-  in.read((char*)&num_features, sizeof(size_t));
-  in.read((char*)arr, sizeof(T) * num_inputs * num_features);
+  read_input_values<T>(input_path, arr, num_inputs, num_features);
 
   nerowsY = 0;
   for(size_t i = 0; i < num_inputs; ++i) {
@@ -684,13 +753,9 @@ void read_input_binary(
     "data type must be either float, double, or half"
   );
 
-  std::fs::path p = input_path;
-  std::ifstream in(p, std::ios::in | std::ios::binary);
   size_t num_inputs;
   size_t num_features;
-  in.read((char*)&num_inputs, sizeof(size_t));
-  in.read((char*)&num_features, sizeof(size_t));
-  in.read((char*)arr, sizeof(T) * num_inputs * num_features);
+  read_input_values<T>(input_path, arr, num_inputs, num_features);
 }
 
 template <typename T>
@@ -706,13 +771,9 @@ void read_input_binary(
     "data type must be either float, double, or half"
   );
 
-  std::fs::path p = input_path;
-  std::ifstream in(p, std::ios::in | std::ios::binary);
   size_t num_inputs;
   size_t num_features;
-  in.read((char*)&num_inputs, sizeof(size_t));
-  in.read((char*)&num_features, sizeof(size_t));
-  in.read((char*)arr, sizeof(T) * num_inputs * num_features);
+  read_input_values<T>(input_path, arr, num_inputs, num_features);
 
   for(size_t i = 0; i < batch_size; ++i) {
     auto it  = std::find_if(
@@ -724,6 +785,27 @@ void read_input_binary(
   }
 }
 
+//number of inputs in the header of a dense or sparse input file
+inline
+size_t read_num_inputs(const std::fs::path& input_path) {
+  using namespace std::literals::string_literals;
+
+  std::ifstream in(input_path, std::ios::in | std::ios::binary);
+  size_t num_inputs;
+  if(is_sparse_input(input_path)) {
+    SparseInputHeader header;
+    in.read((char*)&header, sizeof(SparseInputHeader));
+    num_inputs = header.rows;
+  }
+  else {
+    in.read((char*)&num_inputs, sizeof(size_t));
+  }
+  if(!in) {
+    throw std::runtime_error("cannot read the header of "s + input_path.c_str());
+  }
+  return num_inputs;
+}
+
 inline
 Eigen::Matrix<int, Eigen::Dynamic, 1> read_golden(
   const std::fs::path& golden_path,
@@ -842,90 +924,197 @@ size_t find_max_nnz_binary(
 
   return max_nnz;
 }
+//number of nonzeros and of stored values of each layer file
+//uniform layers store a single value
+template <typename T>
+void find_layer_sizes_binary(
+  const std::fs::path& weight_dir,
+  const size_t num_layers,
+  const size_t num_neurons_per_layer,
+  const size_t N_SLAB,
+  std::vector<size_t>& nnz,
+  std::vector<size_t>& num_vals
+) {
+  nnz.resize(num_layers);
+  num_vals.resize(num_layers);
+  for(size_t i = 0; i < num_layers; ++i) {
+    std::fs::path p = weight_dir;
+    p /= "n" + std::to_string(num_neurons_per_layer) + "-l"
+      + std::to_string(i + 1) + ".b";
+    std::ifstream in(p, std::ios::in | std::ios::binary);
+
+    size_t rows;
+    in.read((char*)&rows, sizeof(size_t));
+    in.read((char*)&nnz[i], sizeof(size_t));
+    num_vals[i] = weight_file_num_vals<T>(p, std::fs::file_size(p), num_neurons_per_layer, N_SLAB, nnz[i]);
+  }
+}
+
 inline
 size_t count_nnz(const std::string& s) {
   return std::count(s.begin(), s.end(), '\n');
 }
 
 template <typename T>
-void tsv_file_to_binary_file(
+TSVStats tsv_layer_to_binary_file(
+  const std::fs::path& weight_dir,
+  const size_t layer,
+  const size_t rows,
+  const size_t cols,
+  const size_t COL_BLK,
+  const size_t N_SLAB,
+  CSRBuilder<T>& builder,
+  ModelWriter<T>* writer
+) {
+  builder.clear();
+
+  std::fs::path p = weight_dir;
+  p /= "n" + std::to_string(cols) + "-l"
+    + std::to_string(layer + 1) + ".tsv";
+
+  //the file is parsed twice, first to count the entries of every row,
+  //then to scatter them into the CSR arrays
+  //each parsing worker gets the same chunks of the same blocks in both passes
+  TSVStats stats = parallel_parse_tsv_file<T>(
+    p, builder.num_workers(),
+    [&](size_t w, int row, int col, T) {
+      builder.count(w, row - 1 + rows * ((col - 1) / COL_BLK));
+    }
+  );
+
+  size_t nnz = builder.nnz();
+
+  auto row_array = std::make_unique<int[]>(rows * N_SLAB + 1);
+  auto col_array = std::make_unique<int[]>(nnz);
+  auto data_array = std::make_unique<T[]>(nnz);
+
+  builder.start(row_array.get(), col_array.get(), data_array.get());
+  stats.seconds += parallel_parse_tsv_file<T>(
+    p, builder.num_workers(),
+    [&](size_t w, int row, int col, T value) {
+      builder.fill(w, row - 1 + rows * ((col - 1) / COL_BLK), col - 1, value);
+    }
+  ).seconds;
+  builder.finish();
+
+  if(writer != nullptr) {
+    writer->write_layer(layer, row_array.get(), col_array.get(), data_array.get(), nnz);
+    return stats;
+  }
+
+  //uniform layers are written with a single value
+  std::fs::path output_file = binary_weight_dir<T>(weight_dir);
+  output_file /= "n" + std::to_string(cols) + "-l"
+    + std::to_string(layer + 1) + ".b";
+
+  write_weight_file<T>(output_file, rows, N_SLAB, row_array.get(), col_array.get(), data_array.get(), nnz);
+  return stats;
+}
+
+template <typename T>
+TSVStats tsv_file_to_binary_file(
   const std::fs::path& weight_dir,
   const size_t num_layers,
   const size_t rows,
   const size_t cols,
   const size_t COL_BLK,
   const size_t N_SLAB,
-  const size_t estimate_nnz
+  const size_t /*estimate_nnz*/,
+  const bool consolidate,
+  const size_t num_threads,
+  const size_t max_layers_in_flight
 ) {
-  //T is either float, half, or double type
+  //T is either float, half, double, or int16_t type
+  //int16_t weights are quantized into binary_weight_dir<int16_t>(weight_dir)
   static_assert(
-    std::is_same<T, float>::value || std::is_same<T, double>::value || std::is_same<T, half>::value,
-    "data type must be either float, double, or half"
+    std::is_same<T, float>::value || std::is_same<T, double>::value || std::is_same<T, half>::value || std::is_same<T, int16_t>::value,
+    "data type must be either float, double, half, or int16_t"
   );
 
-  std::vector<Triplet<T> > triplets;
-  triplets.reserve(estimate_nnz);
+  auto tic = std::chrono::steady_clock::now();
+
+  std::fs::create_directories(binary_weight_dir<T>(weight_dir));
+
+  //consolidate all layers into n{N}-model.b instead of n{N}-l{i}.b
+  std::unique_ptr<ModelWriter<T> > writer;
+  if(consolidate) {
+    std::fs::path model_file = binary_weight_dir<T>(weight_dir);
+    model_file /= model_file_name(cols);
+    writer = std::make_unique<ModelWriter<T> >(model_file, rows, num_layers, COL_BLK, N_SLAB);
+  }
+
+  //lane k converts layers k, k + num_lanes, k + 2 * num_lanes, ... in order
+  //and reuses its buffers, so at most num_lanes layers are in memory
+  //threads left over by the lanes parse each layer
+  size_t num_lanes = std::max(size_t{1}, std::min({max_layers_in_flight, num_threads, num_layers}));
+  size_t threads_per_layer = std::max(size_t{1}, num_threads / num_lanes);
+
+  //a lane holds only the row counters of its builder between layers,
+  //the nonzeros of a layer are never buffered outside its CSR arrays
+  //estimate_nnz is not needed, every layer is counted before it is allocated
+  struct Lane {
+    CSRBuilder<T> builder;
+    TSVStats stats;
+    std::exception_ptr error;
+  };
+  std::vector<Lane> lanes;
+  lanes.reserve(num_lanes);
+  for(size_t k = 0; k < num_lanes; ++k) {
+    lanes.push_back(Lane{CSRBuilder<T>(rows * N_SLAB, threads_per_layer), TSVStats{}, nullptr});
+  }
+
+  tf::Executor executor(num_lanes);
+  tf::Taskflow taskflow("tsv_file_to_binary_file");
+  std::vector<tf::Task> layers(num_layers);
 
   for(size_t i = 0; i < num_layers; ++i) {
-    triplets.clear();
-    std::fs::path p = weight_dir;
-    p /= "n" + std::to_string(cols) + "-l"
-      + std::to_string(i + 1) + ".tsv";
-    std::stringstream read_s = read_file_to_sstream(p);
-    std::vector<std::string> tokens;
-    std::string line;
-
-    while(std::getline(read_s, line)) {
-      std::istringstream lineStream(line);
-      std::string token;
-      tokens.clear();
-      while(std::getline(lineStream, token, '\t')) {
-        tokens.push_back(std::move(token));
+    layers[i] = taskflow.emplace([&, i]() {
+      Lane& lane = lanes[i % num_lanes];
+      if(lane.error) {
+        return;
       }
-      triplets.emplace_back(
-        std::stoi(tokens[0]) - 1 + rows * ((std::stoi(tokens[1]) - 1) / COL_BLK),
-        std::stoi(tokens[1]) - 1,
-        to_numeric<T>(tokens[2])
-      );
-    }
-
-    std::sort(triplets.begin(), triplets.end());
-    size_t nnz = triplets.size();
+      try {
+        lane.stats += tsv_layer_to_binary_file<T>(
+          weight_dir, i, rows, cols, COL_BLK, N_SLAB,
+          lane.builder, writer.get()
+        );
+      }
+      catch(...) {
+        lane.error = std::current_exception();
+      }
+    }).name("layer_" + std::to_string(i + 1));
 
-    auto row_array = std::make_unique<int[]>(rows * N_SLAB + 1);
-    auto col_array = std::make_unique<int[]>(nnz);
-    auto data_array = std::make_unique<T[]>(nnz);
-    
-    std::memset(row_array.get(), 0, sizeof(int) * (rows * N_SLAB + 1));
-    
-    for(size_t j = 0 ; j < nnz; ++j) {
-      ++row_array.get()[triplets[j].row + 1];
-      col_array.get()[j] = triplets[j].col;
-      data_array.get()[j] = triplets[j].value;
+    if(i >= num_lanes) {
+      layers[i - num_lanes].precede(layers[i]);
     }
+  }
 
-    std::partial_sum(row_array.get(), row_array.get() + rows * N_SLAB + 1, row_array.get());
+  executor.run(taskflow).wait();
 
-    std::fs::path output_file = weight_dir;
-    output_file /= "n" + std::to_string(cols) + "-l"
-      + std::to_string(i + 1) + ".b";
+  TSVStats stats;
+  for(auto& lane : lanes) {
+    if(lane.error) {
+      std::rethrow_exception(lane.error);
+    }
+    stats += lane.stats;
+  }
 
-    std::ofstream out(output_file, std::ios::out | std::ios::binary);
-    out.write((char*)&rows, sizeof(size_t));
-    out.write((char*)&nnz, sizeof(size_t));
-    out.write((char*)row_array.get(), sizeof(int) * (rows * N_SLAB + 1));
-    out.write((char*)col_array.get(), sizeof(int) * (nnz));
-    out.write((char*)data_array.get(), sizeof(T) * (nnz));
+  if(writer) {
+    writer->close();
   }
 
-  
+  //lanes overlap, so the throughput is measured on the wall clock
+  stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+  return stats;
 }
 
 template <typename T>
-void tsv_file_to_binary_file(
+TSVStats tsv_file_to_binary_file(
   std::fs::path input_path,
   const size_t rows,
-  const size_t cols
+  const size_t cols,
+  const size_t num_threads,
+  const bool dense
 ) {
   //T is either float, half, or double type
   static_assert(
@@ -935,30 +1124,61 @@ void tsv_file_to_binary_file(
 
   input_path /= "sparse-images-" + std::to_string(cols) + ".tsv";
 
-  auto data_array = std::make_unique<T[]>(rows * cols);
-  std::memset(data_array.get(), 0, sizeof(T) * rows * cols);
+  std::fs::path p = input_path.parent_path();
+  p /= "sparse-images-" + std::to_string(cols) + ".b";
 
-  std::stringstream read_s = read_file_to_sstream(input_path);
-  std::vector<std::string> tokens;
-  std::string line;
-  std::string token;
+  //rows are checked by the builder
+  //the file is parsed twice, first to count the entries of every row,
+  //then to scatter them into the CSR arrays
+  CSRBuilder<T> builder(rows, num_threads);
+  std::vector<int> max_rows(builder.num_workers(), 0);
+  TSVStats stats = parallel_parse_tsv_file<T>(
+    input_path, num_threads,
+    [&](size_t worker, int row, int col, T) {
+      if(row < 1 || col < 1 || static_cast<size_t>(col) > cols) {
+        throw std::runtime_error("input entry out of range");
+      }
+      max_rows[worker] = std::max(max_rows[worker], row);
+      builder.count(worker, row - 1);
+    }
+  );
 
-  while(std::getline(read_s, line)) {
-    std::istringstream lineStream(line);
-    tokens.clear();
-    while(std::getline(lineStream, token, '\t')) {
-      tokens.push_back(std::move(token));
+  //without a given number of rows, the last input is the largest row in the file
+  const size_t num_rows = rows > 0 ? rows : *std::max_element(max_rows.begin(), max_rows.end());
+  builder.set_num_rows(num_rows);
+
+  size_t nnz = builder.nnz();
+  std::vector<int> row_array(num_rows + 1);
+  std::vector<int> col_array(nnz);
+  auto data_array = std::make_unique<T[]>(nnz);
+  builder.start(row_array.data(), col_array.data(), data_array.get());
+  stats.seconds += parallel_parse_tsv_file<T>(
+    input_path, num_threads,
+    [&](size_t worker, int row, int col, T value) {
+      builder.fill(worker, row - 1, col - 1, value);
+    }
+  ).seconds;
+  builder.finish();
+
+  if(dense) {
+    auto dense_array = std::make_unique<T[]>(num_rows * cols);
+    std::memset(dense_array.get(), 0, sizeof(T) * num_rows * cols);
+    for(size_t r = 0; r < num_rows; ++r) {
+      for(int k = row_array[r]; k < row_array[r + 1]; ++k) {
+        dense_array[r * cols + col_array[k]] = data_array[k];
+      }
     }
-    *(data_array.get() + (std::stoi(tokens[0]) - 1) * cols + std::stoi(tokens[1]) - 1) = to_numeric<T>(tokens[2]);
-  }
 
-  std::fs::path p = input_path.parent_path();
-  p /= "sparse-images-" + std::to_string(cols) + ".b";
+    std::ofstream out(p, std::ios::out | std::ios::binary);
+    out.write((char*)&num_rows, sizeof(size_t));
+    out.write((char*)&cols, sizeof(size_t));
+    out.write((char*)dense_array.get(), sizeof(T) * (num_rows * cols));
+    return stats;
+  }
 
-  std::ofstream out(p, std::ios::out | std::ios::binary);
-  out.write((char*)&rows, sizeof(size_t));
-  out.write((char*)&cols, sizeof(size_t));
-  out.write((char*)data_array.get(), sizeof(T) * (rows * cols));
+  std::vector<uint64_t> row_offsets(row_array.begin(), row_array.end());
+  write_sparse_input<T>(p, num_rows, cols, row_offsets.data(), col_array.data(), data_array.get());
+  return stats;
 }
 
 inline
@@ -976,7 +1196,11 @@ void tsv_file_to_binary_file(
   Eigen::Matrix<int, Eigen::Dynamic, 1> golden = Eigen::Matrix<int, Eigen::Dynamic, 1>::Zero(rows, 1);
 
   while(std::getline(read_s, line)) {
-    golden(std::stoi(line) - 1, 0) = 1;
+    int row = std::stoi(line);
+    if(row < 1 || static_cast<size_t>(row) > rows) {
+      throw std::runtime_error("golden category out of range");
+    }
+    golden(row - 1, 0) = 1;
   }   
 
   auto p = golden_path.parent_path();
@@ -1002,32 +1226,28 @@ void diagonal_to_binary_file(
   const size_t N_SLAB
 ) {
   size_t nnz = std::min(rows, cols);
-  for(size_t i = 0; i < num_layers; ++i) {
 
-    auto row_array = std::make_unique<int[]>(rows * N_SLAB + 1);
-    auto col_array = std::make_unique<int[]>(nnz);
-    auto data_array = std::make_unique<T[]>(nnz);
-      
-    std::iota(col_array.get(), col_array.get() + nnz, 0);
-    std::fill(data_array.get(), data_array.get() + nnz, T(30));
-    std::memset(row_array.get(), 0, sizeof(int) * (rows * N_SLAB + 1));
-
-    for(size_t k = 0; k < nnz; ++k) {
-      ++row_array.get()[k + rows * (k / COL_BLK) + 1];
-    }
+  CSRBuilder<T> builder(rows * N_SLAB, 1);
+  for(size_t k = 0; k < nnz; ++k) {
+    builder.count(0, k + rows * (k / COL_BLK));
+  }
 
-    std::partial_sum(row_array.get(), row_array.get() + rows * N_SLAB + 1, row_array.get());
+  auto row_array = std::make_unique<int[]>(rows * N_SLAB + 1);
+  auto col_array = std::make_unique<int[]>(nnz);
+  auto data_array = std::make_unique<T[]>(nnz);
+  builder.start(row_array.get(), col_array.get(), data_array.get());
+  for(size_t k = 0; k < nnz; ++k) {
+    builder.fill(0, k + rows * (k / COL_BLK), k, T(30));
+  }
+  builder.finish();
 
+  //every layer is the same diagonal matrix
+  for(size_t i = 0; i < num_layers; ++i) {
     std::fs::path output_file = weight_dir;
     output_file /= "n" + std::to_string(cols) + "-l"
       + std::to_string(i + 1) + ".b";
     
-    std::ofstream out(output_file, std::ios::out | std::ios::binary);
-    out.write((char*)&rows, sizeof(size_t));
-    out.write((char*)&nnz, sizeof(size_t));
-    out.write((char*)row_array.get(), sizeof(int) * (rows * N_SLAB + 1));
-    out.write((char*)col_array.get(), sizeof(int) * (nnz));
-    out.write((char*)data_array.get(), sizeof(T) * (nnz));
+    write_weight_file<T>(output_file, rows, N_SLAB, row_array.get(), col_array.get(), data_array.get(), nnz);
   }
 }
 
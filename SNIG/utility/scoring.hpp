@@ -1,11 +1,19 @@
 #pragma once
+#include <SNIG/utility/config.hpp>
+#ifdef SNIG_ENABLE_CUDA
 #include <thrust/scan.h>
+#endif
+#include <numeric>
+#include <vector>
+#include <stdexcept>
+#include <iostream>
 #include <Eigen/SparseCore>
 #include <Eigen/Dense>
 #include <SNIG/utility/matrix_format.h>
 
 namespace snig {
 
+#ifdef SNIG_ENABLE_CUDA
 template<typename T>
 __global__
 void identify(
@@ -14,6 +22,7 @@ void identify(
   const size_t num_neurons_per_layer,
   int* result_arr
 );
+#endif
 
 template<typename T>
 Eigen::Matrix<int, Eigen::Dynamic, 1> get_score(
@@ -40,11 +49,19 @@ bool is_passed(
   const Eigen::Matrix<int, Eigen::Dynamic, 1>& golden
 );
 
+//indices of the inputs whose categories differ
+inline
+std::vector<size_t> find_mismatched_categories(
+  const Eigen::Matrix<int, Eigen::Dynamic, 1>& output,
+  const Eigen::Matrix<int, Eigen::Dynamic, 1>& reference
+);
+
 
 //-----------------------------------------------------------------------------
 //Definition of scoring function
 //-----------------------------------------------------------------------------
 
+#ifdef SNIG_ENABLE_CUDA
 template<typename T>
 __global__
 void identify(
@@ -65,6 +82,7 @@ void identify(
     result_arr[i] = sum > 0 ? 1 : 0;
   }
 };
+#endif
 
 
 template<typename T>
@@ -118,9 +136,31 @@ bool is_passed(
   const Eigen::Matrix<int, Eigen::Dynamic, 1>& output,
   const Eigen::Matrix<int, Eigen::Dynamic, 1>& golden
 ) {
+  if(output.rows() != golden.rows()) {
+    std::cout << "\nNumber of outputs " << output.rows()
+              << " does not match number of golden categories " << golden.rows() << std::endl;
+    return false;
+  }
   int check = output.rows() - output.cwiseEqual(golden).count();
   std::cout << "\nNumber of different categories: " << check << std::endl;
   return (check == 0);
 }
 
+inline
+std::vector<size_t> find_mismatched_categories(
+  const Eigen::Matrix<int, Eigen::Dynamic, 1>& output,
+  const Eigen::Matrix<int, Eigen::Dynamic, 1>& reference
+) {
+  if(output.rows() != reference.rows()) {
+    throw std::runtime_error("numbers of categories do not match");
+  }
+  std::vector<size_t> mismatches;
+  for(Eigen::Index i = 0; i < output.rows(); ++i) {
+    if(output(i) != reference(i)) {
+      mismatches.push_back(i);
+    }
+  }
+  return mismatches;
+}
+
 }// end of namespace snig ----------------------------------------------
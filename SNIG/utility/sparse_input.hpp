@@ -0,0 +1,259 @@
+#pragma once
+#include <experimental/filesystem>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+#include <SNIG/utility/model_format.hpp>
+
+namespace std {
+  namespace fs = experimental::filesystem;
+}
+
+namespace snig {
+
+//Sparse input file sparse-images-{N}.b
+//
+//  [SparseInputHeader      48 bytes        ]
+//  [row_offsets            uint64 rows + 1 ]
+//  [col_index              int32  nnz      ]
+//  [value                  T      nnz      ]
+//
+//The dense input file starts with size_t rows instead of the magic,
+//so both formats can share the same file name.
+
+constexpr char INPUT_MAGIC[8] = {'S', 'N', 'I', 'G', 'I', 'N', 'P', '\0'};
+constexpr uint32_t INPUT_VERSION = 1;
+
+struct SparseInputHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t dtype;
+  uint64_t rows;
+  uint64_t cols;
+  uint64_t nnz;
+  uint64_t reserved;
+};
+
+static_assert(sizeof(SparseInputHeader) == 48, "sparse input header must be 48 bytes");
+
+inline
+bool is_sparse_input(const std::fs::path& input_path);
+
+template <typename T>
+void write_sparse_input(
+  const std::fs::path& input_path,
+  const size_t rows,
+  const size_t cols,
+  const uint64_t* row_offsets,
+  const int* col_index,
+  const T* value
+);
+
+template <typename T>
+void scatter_sparse_rows(
+  const uint64_t* row_offsets,
+  const int* col_index,
+  const T* value,
+  const size_t num_rows,
+  const size_t cols,
+  T* Y,
+  bool* is_nonzero_row,
+  const size_t sec_size,
+  const size_t num_secs
+);
+
+template <typename T>
+void reset_rows(
+  const size_t num_rows,
+  const size_t cols,
+  T* Y,
+  bool* is_nonzero_row,
+  const size_t sec_size,
+  const size_t num_secs
+);
+
+template <typename T>
+class SparseInput {
+
+  //Compressed rows of the whole input
+
+  public:
+
+    explicit SparseInput(const std::fs::path& input_path);
+
+    size_t rows() const;
+
+    size_t cols() const;
+
+    size_t nnz() const;
+
+    //writes all rows into the dense array of rows() * cols()
+    void densify(T* arr) const;
+
+  private:
+
+    SparseInputHeader _header;
+    std::vector<uint64_t> _row_offsets;
+    std::vector<int> _col_index;
+    std::vector<T> _value;
+};
+
+//-----------------------------------------------------------------------------
+//Definition of sparse input function
+//-----------------------------------------------------------------------------
+
+inline
+bool is_sparse_input(const std::fs::path& input_path) {
+  std::ifstream in(input_path, std::ios::in | std::ios::binary);
+  char magic[sizeof(INPUT_MAGIC)];
+  in.read(magic, sizeof(magic));
+  return in && std::memcmp(magic, INPUT_MAGIC, sizeof(INPUT_MAGIC)) == 0;
+}
+
+template <typename T>
+void write_sparse_input(
+  const std::fs::path& input_path,
+  const size_t rows,
+  const size_t cols,
+  const uint64_t* row_offsets,
+  const int* col_index,
+  const T* value
+) {
+  using namespace std::literals::string_literals;
+
+  SparseInputHeader header;
+  std::memset(&header, 0, sizeof(SparseInputHeader));
+  std::memcpy(header.magic, INPUT_MAGIC, sizeof(INPUT_MAGIC));
+  header.version = INPUT_VERSION;
+  header.dtype = model_dtype<T>();
+  header.rows = rows;
+  header.cols = cols;
+  header.nnz = row_offsets[rows];
+
+  std::ofstream out(input_path, std::ios::out | std::ios::binary);
+  if(!out) {
+    throw std::runtime_error("cannot open the file"s + input_path.c_str());
+  }
+  out.write((char*)&header, sizeof(SparseInputHeader));
+  out.write((char*)row_offsets, sizeof(uint64_t) * (rows + 1));
+  out.write((char*)col_index, sizeof(int) * header.nnz);
+  out.write((char*)value, sizeof(T) * header.nnz);
+}
+
+//Y and is_nonzero_row must be consistent: sections flagged false are all zero
+//only flagged sections are reset before the nonzeros of each row are scattered
+//entries of row r are [row_offsets[r], row_offsets[r + 1]) relative to row_offsets[0]
+template <typename T>
+void scatter_sparse_rows(
+  const uint64_t* row_offsets,
+  const int* col_index,
+  const T* value,
+  const size_t num_rows,
+  const size_t cols,
+  T* Y,
+  bool* is_nonzero_row,
+  const size_t sec_size,
+  const size_t num_secs
+) {
+  reset_rows(num_rows, cols, Y, is_nonzero_row, sec_size, num_secs);
+
+  for(size_t r = 0; r < num_rows; ++r) {
+    T* y = Y + r * cols;
+    bool* is_nonzero = is_nonzero_row + r * num_secs;
+    for(uint64_t k = row_offsets[r] - row_offsets[0]; k < row_offsets[r + 1] - row_offsets[0]; ++k) {
+      if(value[k] != T(0)) {
+        y[col_index[k]] = value[k];
+        is_nonzero[col_index[k] / sec_size] = true;
+      }
+    }
+  }
+}
+
+//incremental memory resetting of num_rows rows
+template <typename T>
+void reset_rows(
+  const size_t num_rows,
+  const size_t cols,
+  T* Y,
+  bool* is_nonzero_row,
+  const size_t sec_size,
+  const size_t num_secs
+) {
+  for(size_t r = 0; r < num_rows; ++r) {
+    T* y = Y + r * cols;
+    bool* is_nonzero = is_nonzero_row + r * num_secs;
+    for(size_t s = 0; s < num_secs; ++s) {
+      if(is_nonzero[s]) {
+        std::fill(y + s * sec_size, y + (s + 1) * sec_size, T(0));
+        is_nonzero[s] = false;
+      }
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Definition of SparseInput
+// ----------------------------------------------------------------------------
+
+template <typename T>
+SparseInput<T>::SparseInput(const std::fs::path& input_path) {
+  using namespace std::literals::string_literals;
+
+  std::ifstream in(input_path, std::ios::in | std::ios::binary);
+  if(!in) {
+    throw std::runtime_error("cannot open the file"s + input_path.c_str());
+  }
+
+  in.read((char*)&_header, sizeof(SparseInputHeader));
+  if(
+    !in ||
+    std::memcmp(_header.magic, INPUT_MAGIC, sizeof(INPUT_MAGIC)) != 0 ||
+    _header.version != INPUT_VERSION
+  ) {
+    throw std::runtime_error("not a sparse input file "s + input_path.c_str());
+  }
+  if(_header.dtype != model_dtype<T>()) {
+    throw std::runtime_error("data type of "s + input_path.c_str() + " does not match the engine");
+  }
+
+  _row_offsets.resize(_header.rows + 1);
+  _col_index.resize(_header.nnz);
+  _value.resize(_header.nnz);
+  in.read((char*)_row_offsets.data(), sizeof(uint64_t) * (_header.rows + 1));
+  in.read((char*)_col_index.data(), sizeof(int) * _header.nnz);
+  in.read((char*)_value.data(), sizeof(T) * _header.nnz);
+  if(!in || _row_offsets[_header.rows] != _header.nnz) {
+    throw std::runtime_error("sparse input file "s + input_path.c_str() + " is truncated");
+  }
+}
+
+template <typename T>
+size_t SparseInput<T>::rows() const {
+  return _header.rows;
+}
+
+template <typename T>
+size_t SparseInput<T>::cols() const {
+  return _header.cols;
+}
+
+template <typename T>
+size_t SparseInput<T>::nnz() const {
+  return _header.nnz;
+}
+
+template <typename T>
+void SparseInput<T>::densify(T* arr) const {
+  std::fill(arr, arr + _header.rows * _header.cols, T(0));
+  for(size_t row = 0; row < _header.rows; ++row) {
+    for(uint64_t k = _row_offsets[row]; k < _row_offsets[row + 1]; ++k) {
+      arr[row * _header.cols + _col_index[k]] = _value[k];
+    }
+  }
+}
+
+}// end of namespace snig ----------------------------------------------
@@ -0,0 +1,354 @@
+#pragma once
+#include <experimental/filesystem>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+#include <numeric>
+#include <SNIG/utility/utility.hpp>
+#include <SNIG/utility/fixed_point.hpp>
+
+namespace std {
+  namespace fs = experimental::filesystem;
+}
+
+namespace snig {
+
+//Allocation-free parser of "row\tcol\tvalue" lines
+//Files are streamed in blocks split at newline boundaries,
+//and each block is parsed by several threads, one chunk per thread.
+
+struct TSVStats {
+  size_t bytes {0};
+  size_t lines {0};
+  double seconds {0};
+
+  double mb_per_sec() const;
+
+  TSVStats& operator += (const TSVStats& rhs);
+};
+
+inline
+size_t tsv_num_threads();
+
+inline
+int scan_tsv_int(const char*& p, const char* end);
+
+template <typename T>
+T scan_tsv_real(const char*& p, const char* end);
+
+template <typename T, typename F>
+size_t parse_tsv(
+  const char* beg,
+  const char* end,
+  const size_t worker,
+  F&& f
+);
+
+inline
+std::vector<const char*> split_tsv_chunks(
+  const char* beg,
+  const char* end,
+  const size_t num_chunks
+);
+
+template <typename T, typename F>
+size_t parallel_parse_tsv(
+  const char* beg,
+  const char* end,
+  const size_t num_threads,
+  F&& f
+);
+
+template <typename T, typename F>
+TSVStats parallel_parse_tsv_file(
+  const std::fs::path& path,
+  const size_t num_threads,
+  F&& f,
+  const size_t block_size = size_t{64} << 20
+);
+
+template <typename E>
+std::vector<E> concat_tsv_parts(std::vector<std::vector<E> >& parts);
+
+//-----------------------------------------------------------------------------
+//Definition of tsv parser function
+//-----------------------------------------------------------------------------
+
+inline
+double TSVStats::mb_per_sec() const {
+  return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+}
+
+inline
+TSVStats& TSVStats::operator += (const TSVStats& rhs) {
+  bytes += rhs.bytes;
+  lines += rhs.lines;
+  seconds += rhs.seconds;
+  return *this;
+}
+
+inline
+size_t tsv_num_threads() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+inline
+bool is_tsv_digit(const char c) {
+  return static_cast<unsigned>(c - '0') < 10;
+}
+
+//skips separators within a line, never crosses '\n'
+inline
+const char* skip_tsv_blank(const char* p, const char* end) {
+  while(p < end && (*p == '\t' || *p == ' ' || *p == '\r')) {
+    ++p;
+  }
+  return p;
+}
+
+inline
+int scan_tsv_int(const char*& p, const char* end) {
+  p = skip_tsv_blank(p, end);
+
+  bool neg = false;
+  if(p < end && (*p == '-' || *p == '+')) {
+    neg = (*p == '-');
+    ++p;
+  }
+  if(p == end || !is_tsv_digit(*p)) {
+    throw std::runtime_error("invalid integer in tsv");
+  }
+
+  long v = 0;
+  while(p < end && is_tsv_digit(*p)) {
+    v = v * 10 + (*p++ - '0');
+  }
+  return static_cast<int>(neg ? -v : v);
+}
+
+//decimal mantissa and power of ten are exact in R for short numbers,
+//so one multiplication or division rounds correctly (Clinger's fast path)
+//other numbers fall back to strtof/strtod
+//types other than double are parsed as float and converted,
+//int16_t is quantized to Q8.7 fixed point
+template <typename T>
+T scan_tsv_real(const char*& p, const char* end) {
+  using R = std::conditional_t<std::is_same<T, double>::value, double, float>;
+
+  //largest exact mantissa and power of ten of R
+  constexpr uint64_t max_mantissa = std::is_same<R, float>::value ? (uint64_t{1} << 24) : (uint64_t{1} << 53);
+  constexpr int max_exp10 = std::is_same<R, float>::value ? 10 : 22;
+  static const R pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  p = skip_tsv_blank(p, end);
+  const char* beg = p;
+
+  bool neg = false;
+  if(p < end && (*p == '-' || *p == '+')) {
+    neg = (*p == '-');
+    ++p;
+  }
+
+  uint64_t mantissa = 0;
+  int exp10 = 0;
+  bool exact = true;
+  bool has_digits = false;
+
+  for(; p < end && is_tsv_digit(*p); ++p) {
+    has_digits = true;
+    if(mantissa < max_mantissa) {
+      mantissa = mantissa * 10 + (*p - '0');
+    }
+    else {
+      exact &= (*p == '0');
+      ++exp10;
+    }
+  }
+  if(p < end && *p == '.') {
+    for(++p; p < end && is_tsv_digit(*p); ++p) {
+      has_digits = true;
+      if(mantissa < max_mantissa) {
+        mantissa = mantissa * 10 + (*p - '0');
+        --exp10;
+      }
+      else {
+        exact &= (*p == '0');
+      }
+    }
+  }
+  if(!has_digits) {
+    throw std::runtime_error("invalid number in tsv");
+  }
+  if(p < end && (*p == 'e' || *p == 'E')) {
+    ++p;
+    exp10 += scan_tsv_int(p, end);
+  }
+
+  if(exact && mantissa <= max_mantissa && exp10 >= -max_exp10 && exp10 <= max_exp10) {
+    R v = static_cast<R>(mantissa);
+    v = exp10 < 0 ? v / pow10[-exp10] : v * pow10[exp10];
+    return ValueTraits<T>::from_real(neg ? -v : v);
+  }
+
+  //lines always end before '\n' or the terminating '\0' of the buffer
+  char* last;
+  R v = std::is_same<R, float>::value ? std::strtof(beg, &last) : std::strtod(beg, &last);
+  p = last;
+  return ValueTraits<T>::from_real(v);
+}
+
+//calls f(worker, row, col, value) for each line of [beg, end)
+//row and col are given as in the file (1-based)
+template <typename T, typename F>
+size_t parse_tsv(
+  const char* beg,
+  const char* end,
+  const size_t worker,
+  F&& f
+) {
+  size_t lines = 0;
+  const char* p = beg;
+  while(p < end) {
+    p = skip_tsv_blank(p, end);
+    if(p == end) {
+      break;
+    }
+    if(*p == '\n') {
+      ++p;
+      continue;
+    }
+
+    int row = scan_tsv_int(p, end);
+    int col = scan_tsv_int(p, end);
+    T value = scan_tsv_real<T>(p, end);
+    f(worker, row, col, value);
+    ++lines;
+
+    const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    p = (eol == nullptr) ? end : eol + 1;
+  }
+  return lines;
+}
+
+inline
+std::vector<const char*> split_tsv_chunks(
+  const char* beg,
+  const char* end,
+  const size_t num_chunks
+) {
+  std::vector<const char*> bounds{beg};
+  size_t len = end - beg;
+  for(size_t k = 1; k < num_chunks; ++k) {
+    const char* p = std::max(beg + len * k / num_chunks, bounds.back());
+    const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    if(eol == nullptr) {
+      break;
+    }
+    bounds.push_back(eol + 1);
+  }
+  bounds.push_back(end);
+  return bounds;
+}
+
+//f must be safe to call concurrently with different workers
+template <typename T, typename F>
+size_t parallel_parse_tsv(
+  const char* beg,
+  const char* end,
+  const size_t num_threads,
+  F&& f
+) {
+  //small buffers are not worth spawning threads
+  constexpr size_t min_chunk_bytes = size_t{1} << 20;
+  size_t num_chunks = std::max(
+    size_t{1},
+    std::min(num_threads, static_cast<size_t>(end - beg) / min_chunk_bytes)
+  );
+
+  auto bounds = split_tsv_chunks(beg, end, num_chunks);
+  num_chunks = bounds.size() - 1;
+
+  std::vector<size_t> lines(num_chunks, 0);
+  parallel_workers(num_chunks, [&](size_t k) {
+    lines[k] = parse_tsv<T>(bounds[k], bounds[k + 1], k, f);
+  });
+  return std::accumulate(lines.begin(), lines.end(), size_t{0});
+}
+
+//streams the file in blocks of block_size bytes
+//a partial last line is carried over to the next block
+template <typename T, typename F>
+TSVStats parallel_parse_tsv_file(
+  const std::fs::path& path,
+  const size_t num_threads,
+  F&& f,
+  const size_t block_size
+) {
+  using namespace std::literals::string_literals;
+
+  auto tic = std::chrono::steady_clock::now();
+
+  std::ifstream in(path, std::ios::in | std::ios::binary);
+  if(!in) {
+    throw std::runtime_error("cannot open the file"s + path.c_str());
+  }
+
+  //small files are read at once without a full-sized block
+  const size_t read_size = std::min(block_size, static_cast<size_t>(std::fs::file_size(path)) + 1);
+
+  TSVStats stats;
+  std::string buf;
+  size_t carry = 0;
+  while(in) {
+    buf.resize(carry + read_size);
+    in.read(&buf[carry], read_size);
+    size_t len = carry + in.gcount();
+    stats.bytes += in.gcount();
+
+    //parse up to the last complete line, or everything at the end of file
+    size_t parse_len = len;
+    if(in) {
+      size_t eol = buf.rfind('\n', len - 1);
+      parse_len = (eol == std::string::npos) ? 0 : eol + 1;
+    }
+    //terminate the buffer for the strtof/strtod fallback
+    buf.resize(len);
+    stats.lines += parallel_parse_tsv<T>(buf.data(), buf.data() + parse_len, num_threads, f);
+
+    carry = len - parse_len;
+    std::memmove(&buf[0], buf.data() + parse_len, carry);
+  }
+
+  stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+  return stats;
+}
+
+//moves the per-worker outputs of a parallel parse into one vector
+template <typename E>
+std::vector<E> concat_tsv_parts(std::vector<std::vector<E> >& parts) {
+  size_t total = 0;
+  for(auto& part : parts) {
+    total += part.size();
+  }
+  std::vector<E> all = std::move(parts[0]);
+  all.reserve(total);
+  for(size_t w = 1; w < parts.size(); ++w) {
+    all.insert(all.end(), parts[w].begin(), parts[w].end());
+    std::vector<E>().swap(parts[w]);
+  }
+  return all;
+}
+
+}// end of namespace snig ----------------------------------------------
@@ -1,12 +1,25 @@
 #pragma once
 #include <functional>
 #include <algorithm>
+#include <numeric>
+#include <vector>
+#include <iostream>
+#include <thread>
+#include <exception>
+#include <SNIG/utility/config.hpp>
+#include <SNIG/utility/fixed_point.hpp>
 
 namespace snig {
 
 template<typename T>
 size_t get_sec_size(const size_t num_neurons);
 
+template<typename T>
+size_t get_sec_size(
+  const size_t num_neurons,
+  const size_t max_sec_bytes
+);
+
 inline
 float average_zero_percent_in_non_empty_rows(
   int* rlenY,
@@ -15,6 +28,9 @@ float average_zero_percent_in_non_empty_rows(
   size_t nerowsY
 );
 
+template <typename F>
+void parallel_workers(const size_t num_workers, F&& f);
+
 inline
 void num_nonzero_row_percent(std::vector<size_t>& nerows);
 
@@ -28,16 +44,30 @@ void num_nonzero_row(std::vector<size_t>& nerows);
 template<typename T>
 size_t get_sec_size(const size_t num_neurons) {
 
+#ifdef SNIG_ENABLE_CUDA
   //only for the same GPUs
   //
   //get tuned shared memory size
-  //num_neurons must be divisible by shared memory (a.k.a. sec_size)
-  //only for double float
   cudaDeviceProp props;
   cudaGetDeviceProperties(&props, 0);
+  return get_sec_size<T>(num_neurons, props.sharedMemPerBlock);
+#else
+  //a section is sized to the configured cache budget
+  return get_sec_size<T>(num_neurons, SNIG_SEC_CACHE_SIZE);
+#endif
+}
+
+template<typename T>
+size_t get_sec_size(
+  const size_t num_neurons,
+  const size_t max_sec_bytes
+) {
+  //num_neurons must be divisible by sec_size
+  //only for double float
+  //a section holds one accumulator per neuron, int16_t accumulates in int32_t
   size_t sec_size{0};
 
-  size_t max_num_per_block = props.sharedMemPerBlock / sizeof(T);
+  size_t max_num_per_block = max_sec_bytes / sizeof(typename ValueTraits<T>::acc_type);
   if(num_neurons <= max_num_per_block) {
     sec_size = num_neurons;
   }
@@ -52,6 +82,38 @@ size_t get_sec_size(const size_t num_neurons) {
   return sec_size;
 }
 
+//calls f(w) for w in [0, num_workers), each on its own thread
+//worker 0 runs on the calling thread, and the first exception is rethrown
+template <typename F>
+void parallel_workers(const size_t num_workers, F&& f) {
+  std::vector<std::exception_ptr> errors(num_workers);
+  auto run = [&](size_t w) {
+    try {
+      f(w);
+    }
+    catch(...) {
+      errors[w] = std::current_exception();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for(size_t w = 1; w < num_workers; ++w) {
+    threads.emplace_back(run, w);
+  }
+  if(num_workers > 0) {
+    run(0);
+  }
+  for(auto& t : threads) {
+    t.join();
+  }
+
+  for(auto& e : errors) {
+    if(e) {
+      std::rethrow_exception(e);
+    }
+  }
+}
+
 inline
 float average_zero_percent_in_non_empty_rows(
   int* rlenY,
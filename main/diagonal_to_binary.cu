@@ -1,5 +1,6 @@
 #include <CLI11/CLI11.hpp>
 #include <SNIG/utility/reader.hpp>
+#include <SNIG/utility/utility.hpp>
 
 
 int main(int argc, char* argv[]) {
@@ -13,13 +14,15 @@ int main(int argc, char* argv[]) {
   //          --input_path(-i)  output path of input
   //          --golden_path(-g) output path of golden
   //          --golden_all  Convert all golden files less or equal to  --layers
+  //          --num_inputs  number of inputs
 
   // example1:
   //        ./diagonal_to_binary 
   // example2:
   //        ./diagonal_to_binary -n 1024 -l 1920 -w ../sample_data/test/weight/neuron1024/ -i ../sample_data/test/MNIST/ -g ../sample_data/test/MNIST/ --golden_all true
 
-  // COL_BLK, N_SLAB would be caculated automatically, based on GPU architecture.
+  // COL_BLK, N_SLAB would be caculated automatically, based on GPU architecture,
+  // or on SNIG_SEC_CACHE_SIZE in host-only builds.
 
   CLI::App app{"Digonal_test_data_Generator"};
 
@@ -38,6 +41,11 @@ int main(int argc, char* argv[]) {
     golden_all, 
     "this would convert all golden files with the same neurons. Otherwise only specific num_layers and num_neurons would be converted. Default is true");
 
+  size_t num_inputs = 60000;
+  app.add_option("--num_inputs", 
+    num_inputs, 
+    "select number of inputs, default is 60000");
+
   std::fs::path weight_path("../sample_data/test/weight/neuron1024/");
   app.add_option("-w, --weight_path", 
     weight_path, 
@@ -58,20 +66,7 @@ int main(int argc, char* argv[]) {
   size_t COL_BLK;
   size_t N_SLAB;
 
-  cudaDeviceProp props;
-  cudaGetDeviceProperties(&props, 0);
-  size_t max_num_per_block = props.sharedMemPerBlock / sizeof(float);
-
-  if(num_neurons_per_layer <= max_num_per_block) {
-    COL_BLK = num_neurons_per_layer;
-  }
-  else{
-    int max_divisor = 2;
-    while((num_neurons_per_layer % max_divisor != 0) || (max_num_per_block < (num_neurons_per_layer / max_divisor))) {
-      ++max_divisor;
-    }
-    COL_BLK = num_neurons_per_layer / max_divisor;
-  }
+  COL_BLK = snig::get_sec_size<float>(num_neurons_per_layer);
 
   N_SLAB = num_neurons_per_layer / COL_BLK; 
 
@@ -90,7 +85,7 @@ int main(int argc, char* argv[]) {
 
   snig::diagonal_to_binary_file<float>(
     input_path,
-    60000,
+    num_inputs,
     num_neurons_per_layer
   );
 
@@ -101,7 +96,7 @@ int main(int argc, char* argv[]) {
       golden_path,
       num_neurons_per_layer,
       num_layers,
-      60000
+      num_inputs
     );
   }
   else{
@@ -110,7 +105,7 @@ int main(int argc, char* argv[]) {
         golden_path,
         num_neurons_per_layer,
         i,
-        60000
+        num_inputs
       );
     }
   }
@@ -3,21 +3,33 @@
 #include <SNIG/utility/reader.hpp>
 #include <SNIG/utility/scoring.hpp>
 #include <iostream>
+#include <thread>
 
 int main(int argc, char* argv[]) {
 
   //  ***All files should be converted to binary first***
 
   // usage: 
-  //        --mode(-m)                   :  mode (SNIG, GPipe, BF)
-  //        --weight(-w)                 :  path of weight directory
+  //        --mode(-m)                   :  mode (SNIG, GPipe, BF, CPU), host-only builds support CPU only
+  //        --weight(-w)                 :  path of weight directory or of a single model file (n{N}-model.b)
   //        --input(-i)                  :  path of input file
   //        --golden(-g)                 :  path of golden file
   //        --num_neurons(-n)            :  number of neurons 1024, 4096, 16384, or 65536
   //        --num_layers(-l)             :  number of layers 120, 480, or 1920
   //        --bias(-b)                   :  bias
   //        --num_gpus                   :  number of GPUs 1, 2, 3, 4, ...
-  //        --input_batch_size           :  input batch size, must be a factor of num_inputs (60000)
+  //        --num_threads                :  number of CPU threads for CPU mode
+  //        --mmap_weight                :  memory-map weight files instead of reading them for CPU mode (true, false)
+  //        --compress_weight            :  hold the weight compressed in memory and decode layers ahead of inference for CPU mode (true, false)
+  //        --data_type                  :  data type of CPU mode (float, int16, half), int16 and half read the weights converted by to_binary --quantize and --half
+  //        --validate                   :  with int16 or half, also run float and report inputs whose categories differ (true, false)
+  //        --weight_layout              :  weight layout for CPU mode (auto, push, pull)
+  //        --interleave                 :  run CPU mode on batch-interleaved activations of 16 inputs (true, false)
+  //        --cache_block                :  run chunks of rows through groups of layers sized to the caches for CPU mode (true, false)
+  //        --stationary_batches         :  number of input batches each worker runs in lockstep on weight blocks sized to L2 for CPU mode, 0 disables
+  //        --task_chunk                 :  number of layers per task of the task graph for CPU mode, 0 runs worker threads
+  //        --rebatch_interval           :  number of layers after which survivors are merged into full batches for CPU mode, 0 disables re-batching
+  //        --input_batch_size           :  input batch size, the last batch may be smaller
   //        --num_weight_buffers         :  number of weight buffers, must be an even number
   //        --thread_dimension           :  thread dimsion for inference kernel, constrained by the maximum number of threads (typically 1024)
 
@@ -27,21 +39,28 @@ int main(int argc, char* argv[]) {
   //example2:  
   //        ./snig  -m SNIG -w ../sample_data/weight/neuron1024/ -i ../sample_data/MNIST/sparse-images-1024.b -g ../sample_data/MNIST/neuron1024-l120-categories.b -n 1024 -l 120 -b -0.3 --num_gpus 1 --input_batch_size 5000 --num_weight_buffers 2 --thread_dimension 2 512 1
 
+  //example3:
+  //        ./snig  -m CPU -w ../sample_data/weight/neuron1024/ -i ../sample_data/MNIST/sparse-images-1024.b -g ../sample_data/MNIST/neuron1024-l120-categories.b -n 1024 -l 120 -b -0.3 --num_threads 16 --input_batch_size 500
+
   CLI::App app{"SNIG"};
 
+#ifdef SNIG_ENABLE_CUDA
   std::string mode = "SNIG";
+#else
+  std::string mode = "CPU";
+#endif
   app.add_option(
     "-m, --mode", 
     mode, 
-    "select mode(SNIG, GPipe, or BF), default is SNIG"
+    "select mode(SNIG, GPipe, BF, or CPU), default is SNIG (CPU in host-only builds)"
   );
 
   std::fs::path weight_path("../sample_data/weight/neuron1024/");
   app.add_option(
     "-w, --weight",
     weight_path,
-    "weight directory path"
-  )->check(CLI::ExistingDirectory);
+    "weight directory or model file path"
+  )->check(CLI::ExistingPath);
 
   std::fs::path input_path("../sample_data/MNIST/sparse-images-1024.b");
   app.add_option(
@@ -86,6 +105,83 @@ int main(int argc, char* argv[]) {
     "number of GPUs, default is 1"
   );
   
+  size_t num_threads = std::thread::hardware_concurrency();
+  app.add_option(
+    "--num_threads",
+    num_threads,
+    "number of CPU threads used by CPU mode, default is the number of hardware threads"
+  );
+
+  bool mmap_weight = true;
+  app.add_option(
+    "--mmap_weight",
+    mmap_weight,
+    "memory-map weight files instead of reading them, only for CPU mode, default is true"
+  );
+
+  bool compress_weight = false;
+  app.add_option(
+    "--compress_weight",
+    compress_weight,
+    "hold the weight delta and bit-packed in memory and decode layers just ahead of inference, only for CPU mode, overrides --mmap_weight and forces the push layout, default is false"
+  );
+
+  std::string data_type = "float";
+  app.add_option(
+    "--data_type",
+    data_type,
+    "data type (float, int16, half), only for CPU mode, int16 approximates float with Q5.10 activations and Q8.7 weights and half stores 16-bit floats, both on the weights in the int16 or half subdirectory of --weight, default is float"
+  )->check(CLI::IsMember({"float", "int16", "half"}));
+
+  bool validate = false;
+  app.add_option(
+    "--validate",
+    validate,
+    "with --data_type int16 or half, also run float on --weight and report inputs whose categories differ, default is false"
+  );
+
+  std::string weight_layout = "auto";
+  app.add_option(
+    "--weight_layout",
+    weight_layout,
+    "weight layout (auto, push, pull), only for CPU mode, default is auto, which picks the faster layout per layer"
+  )->check(CLI::IsMember({"auto", "push", "pull"}));
+
+  size_t rebatch_interval = 0;
+  app.add_option(
+    "--rebatch_interval",
+    rebatch_interval,
+    "number of layers after which surviving inputs are merged into full batches, only for CPU mode, default is 0 (disabled)"
+  );
+
+  bool interleave = false;
+  app.add_option(
+    "--interleave",
+    interleave,
+    "run on batch-interleaved activations of 16 inputs per tile, only for CPU mode, default is false"
+  );
+
+  bool cache_block = false;
+  app.add_option(
+    "--cache_block",
+    cache_block,
+    "run chunks of rows through groups of consecutive layers while their activations stay in L2, chunk size and group depth follow the cache sizes, only for CPU mode, default is false"
+  );
+
+  size_t stationary_batches = 0;
+  app.add_option(
+    "--stationary_batches",
+    stationary_batches,
+    "number of input batches each worker runs in lockstep, each block of output sections of a layer, sized to half of L2, runs on all of their rows before the next block, only for CPU mode, default is 0 (disabled)"
+  );
+
+  size_t task_chunk = 0;
+  app.add_option(
+    "--task_chunk",
+    task_chunk,
+    "run CPU mode as a task graph where each chunk of this many layers of a batch is a task, so batches move through different layers at once on the work-stealing executor, ignored with re-batching or interleaving, default is 0 (worker threads)"
+  );
+
   size_t num_weight_buffers = 2;
   app.add_option(
     "--num_weight_buffers", 
@@ -97,7 +193,7 @@ int main(int argc, char* argv[]) {
   app.add_option(
     "--input_batch_size", 
     input_batch_size,
-    "number of input bath size, default is 5000, must be a factor of num_input (60000)"
+    "number of input bath size, default is 5000, the last batch holds the remaining inputs"
   );
 
   //for kernel dimesion
@@ -117,11 +213,65 @@ int main(int argc, char* argv[]) {
 
   Eigen::Matrix<int, Eigen::Dynamic, 1> result;
 
+  //the number of inputs comes from the header of the input file
+  size_t num_inputs = snig::read_num_inputs(input_path);
+
+#ifdef SNIG_ENABLE_CUDA
   dim3 thread_dimension{thread_vector[0], thread_vector[1], thread_vector[2]};
+#endif
 
   std::cout << "Current mode: " << mode << std::endl;
 
-  if(mode == "SNIG") {
+  if(mode == "CPU" && data_type != "float") {
+    //16-bit weights are converted into a subdirectory of the float weights
+    auto infer_cpu = [&](auto type) {
+      using T = decltype(type);
+      snig::CPU<T> cpu(
+        snig::binary_weight_dir<T>(weight_path),
+        bias,
+        num_neurons,
+        num_layers,
+        mmap_weight,
+        snig::to_weight_layout(weight_layout),
+        compress_weight
+      );
+      return cpu.infer(input_path, num_inputs, input_batch_size, num_threads, rebatch_interval, interleave, cache_block, stationary_batches, task_chunk);
+    };
+    result = data_type == "int16" ? infer_cpu(int16_t{}) : infer_cpu(snig::half{});
+    if(validate) {
+      std::cout << "Validating against float......\n";
+      snig::CPU<float> cpu(
+        weight_path,
+        bias,
+        num_neurons,
+        num_layers,
+        mmap_weight,
+        snig::to_weight_layout(weight_layout),
+        compress_weight
+      );
+      auto reference = cpu.infer(input_path, num_inputs, input_batch_size, num_threads, rebatch_interval, interleave, cache_block, stationary_batches, task_chunk);
+      auto mismatches = snig::find_mismatched_categories(result, reference);
+      std::cout << "Number of categories differing from float: " << mismatches.size() << "\n";
+      for(size_t i = 0; i < std::min(mismatches.size(), size_t{10}); ++i) {
+        std::cout << "  input " << mismatches[i] + 1 << " : " << data_type << " " << result(mismatches[i])
+                  << ", float " << reference(mismatches[i]) << "\n";
+      }
+    }
+  }
+  else if(mode == "CPU" && data_type == "float") {
+    snig::CPU<float> cpu(
+      weight_path,
+      bias,
+      num_neurons,
+      num_layers,
+      mmap_weight,
+      snig::to_weight_layout(weight_layout),
+      compress_weight
+    );
+    result = cpu.infer(input_path, num_inputs, input_batch_size, num_threads, rebatch_interval, interleave, cache_block, stationary_batches, task_chunk);
+  }
+#ifdef SNIG_ENABLE_CUDA
+  else if(mode == "SNIG") {
     snig::SNIG<float> snig(
       thread_dimension,
       weight_path, 
@@ -129,7 +279,7 @@ int main(int argc, char* argv[]) {
       num_neurons, 
       num_layers
     );
-    result = snig.infer(input_path, 60000, input_batch_size, num_weight_buffers, num_gpus);
+    result = snig.infer(input_path, num_inputs, input_batch_size, num_weight_buffers, num_gpus);
   }
   else if(mode == "GPipe") {
     snig::GPipe<float> gpipe(
@@ -139,7 +289,7 @@ int main(int argc, char* argv[]) {
       num_neurons, 
       num_layers
     );
-    result = gpipe.infer(input_path, 60000, input_batch_size, num_gpus);
+    result = gpipe.infer(input_path, num_inputs, input_batch_size, num_gpus);
   }
   else if(mode == "BF") {
     //only perform initial partition since we don't have NVLink 
@@ -150,8 +300,9 @@ int main(int argc, char* argv[]) {
       num_neurons, 
       num_layers
     );
-    result = bf.infer(input_path, 60000, num_gpus);
+    result = bf.infer(input_path, num_inputs, num_gpus);
   }
+#endif
   else {
     using namespace std::literals::string_literals;
     throw std::runtime_error("Error mode. Please correct your mode name"s);
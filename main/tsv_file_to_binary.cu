@@ -10,15 +10,31 @@ void convert_to_binary(
   const size_t num_neurons,
   const size_t sec_size,
   const size_t num_secs,
+  const bool consolidate,
+  const size_t num_threads,
+  const size_t max_layers_in_flight,
+  const bool dense_input,
+  const size_t num_inputs,
+  const bool quantize,
+  const bool half,
   const size_t num_layers=1920
 );
 
+void report_parsing(const snig::TSVStats& stats);
+
 int main(int argc, char* argv[]) {
 
   // usage: ./to_binary
   //          --neurons(-n) :  1024, 4096, or 16384
   //          --convert_all :  convert all files (true, false)
   //          --sample_data :  use sample_data (true, false)
+  //          --consolidate :  write all layers into a single n{N}-model.b (true, false)
+  //          --num_threads :  number of threads converting the files
+  //          --max_layers_in_flight :  number of weight layers converted concurrently
+  //          --dense_input :  write inputs as a dense rows * cols array (true, false)
+  //          --num_inputs :  number of inputs, 0 takes the largest input index of the input file
+  //          --quantize :  also write Q8.7 int16 weights into the int16 subdirectory of the weights (true, false)
+  //          --half :  also write half precision weights into the half subdirectory of the weights (true, false)
 
   // example1:
   //        ./to_binary --sample_data true
@@ -26,8 +42,11 @@ int main(int argc, char* argv[]) {
   //        ./to_binary -n 1024
   // example3:
   //        ./to_binary -convert_all true
+  // example4:
+  //        ./to_binary -n 1024 --consolidate true
 
-  // sec_size, num_secs would be caculated automatically based on GPU architecture.
+  // sec_size, num_secs would be caculated automatically based on GPU architecture,
+  // or on SNIG_SEC_CACHE_SIZE in host-only builds.
 
   CLI::App app{"Converter"};
 
@@ -52,6 +71,55 @@ int main(int argc, char* argv[]) {
     "convert sample data to binary file, default is false"
   );
 
+  bool consolidate = false;
+  app.add_option(
+    "--consolidate", 
+    consolidate, 
+    "write weights into a single model file, default is false"
+  );
+
+  size_t num_threads = snig::tsv_num_threads();
+  app.add_option(
+    "--num_threads", 
+    num_threads, 
+    "number of threads converting the files, default is the number of hardware threads"
+  );
+
+  size_t max_layers_in_flight = 8;
+  app.add_option(
+    "--max_layers_in_flight", 
+    max_layers_in_flight, 
+    "number of weight layers converted concurrently, bounds the memory usage, default is 8"
+  );
+
+  bool dense_input = false;
+  app.add_option(
+    "--dense_input", 
+    dense_input, 
+    "write inputs in the dense format instead of the sparse format, default is false"
+  );
+
+  size_t num_inputs = 0;
+  app.add_option(
+    "--num_inputs", 
+    num_inputs, 
+    "number of inputs, default is 0, which takes the largest input index of the input file"
+  );
+
+  bool quantize = false;
+  app.add_option(
+    "--quantize", 
+    quantize, 
+    "also write weights quantized to Q8.7 int16 fixed point into the int16 subdirectory of the weights, default is false"
+  );
+
+  bool half = false;
+  app.add_option(
+    "--half", 
+    half, 
+    "also write half precision weights into the half subdirectory of the weights, default is false"
+  );
+
   std::fs::path weight_path;
 
   std::fs::path input_path;
@@ -81,9 +149,16 @@ int main(int argc, char* argv[]) {
       neuron,
       sec_size,
       num_secs,
+      consolidate,
+      num_threads,
+      max_layers_in_flight,
+      dense_input,
+      num_inputs,
+      quantize,
+      half,
       120
     );
-    return;
+    return 0;
   }
 
   //convert all benchmarks
@@ -101,10 +176,17 @@ int main(int argc, char* argv[]) {
         golden_path,
         neuron,
         sec_size,
-        num_secs
+        num_secs,
+        consolidate,
+        num_threads,
+        max_layers_in_flight,
+        dense_input,
+        num_inputs,
+        quantize,
+        half
       );
     }
-    return;
+    return 0;
   }
 
   //convert benchmarks with num_neurons neruons
@@ -120,7 +202,14 @@ int main(int argc, char* argv[]) {
     golden_path,
     num_neurons,
     sec_size,
-    num_secs
+    num_secs,
+    consolidate,
+    num_threads,
+    max_layers_in_flight,
+    dense_input,
+    num_inputs,
+    quantize,
+    half
   );
 
 
@@ -134,49 +223,140 @@ void convert_to_binary(
   const size_t num_neurons,
   const size_t sec_size,
   const size_t num_secs,
+  const bool consolidate,
+  const size_t num_threads,
+  const size_t max_layers_in_flight,
+  const bool dense_input,
+  const size_t num_inputs,
+  const bool quantize,
+  const bool half,
   const size_t num_layers
 ) {
 
   std::cout << "num_neurons : " << num_neurons << std::endl;
 
-  std::cout << "Transforming weight files... \n";
-  snig::tsv_file_to_binary_file<float>(
-    weight_path,
-    num_layers,
-    num_neurons,
-    num_neurons,
-    sec_size,
-    num_secs,
-    num_neurons * 32
-  ); 
+  std::cout << "Transforming weight, input, and golden files...\n";
 
-  std::cout << "Transforming input files...\n";
+  snig::TSVStats weight_stats;
+  snig::TSVStats quantized_stats;
+  snig::TSVStats half_stats;
+  snig::TSVStats input_stats;
 
-  snig::tsv_file_to_binary_file<float>(
-    input_path,
-    60000,
-    num_neurons
-  );
+  //weights are independent of inputs
+  //goldens take the number of inputs from the converted input file
+  tf::Executor executor(2);
+  tf::Taskflow taskflow("Converter");
+
+  tf::Task weight = taskflow.emplace([&](){
+    weight_stats = snig::tsv_file_to_binary_file<float>(
+      weight_path,
+      num_layers,
+      num_neurons,
+      num_neurons,
+      sec_size,
+      num_secs,
+      num_neurons * 32,
+      consolidate,
+      num_threads,
+      max_layers_in_flight
+    ); 
+  }).name("weight");
+
+  //16-bit weights reparse the text files one after another after the float weights,
+  //which bounds the memory usage and finds the files in the page cache
+  tf::Task last_weight = weight;
+  if(quantize) {
+    tf::Task quantized_weight = taskflow.emplace([&](){
+      quantized_stats = snig::tsv_file_to_binary_file<int16_t>(
+        weight_path,
+        num_layers,
+        num_neurons,
+        num_neurons,
+        sec_size,
+        num_secs,
+        num_neurons * 32,
+        consolidate,
+        num_threads,
+        max_layers_in_flight
+      );
+    }).name("quantized_weight");
+    last_weight.precede(quantized_weight);
+    last_weight = quantized_weight;
+  }
+  if(half) {
+    tf::Task half_weight = taskflow.emplace([&](){
+      half_stats = snig::tsv_file_to_binary_file<snig::half>(
+        weight_path,
+        num_layers,
+        num_neurons,
+        num_neurons,
+        sec_size,
+        num_secs,
+        num_neurons * 32,
+        consolidate,
+        num_threads,
+        max_layers_in_flight
+      );
+    }).name("half_weight");
+    last_weight.precede(half_weight);
+  }
 
-  std::cout << "Transforming golden files...\n";
+  size_t rows;
+
+  tf::Task input = taskflow.emplace([&](){
+    input_stats = snig::tsv_file_to_binary_file<float>(
+      input_path,
+      num_inputs,
+      num_neurons,
+      num_threads,
+      dense_input
+    );
+    rows = snig::read_num_inputs(input_path / ("sparse-images-" + std::to_string(num_neurons) + ".b"));
+  }).name("input");
 
-  if(num_layers == 1920) {
-    std::vector<int> layers_vec{120, 480, 1920};
-    for(int i = 0; i < 3; ++i) {
+  tf::Task golden = taskflow.emplace([&](){
+    if(num_layers == 1920) {
+      std::vector<int> layers_vec{120, 480, 1920};
+      for(int i = 0; i < 3; ++i) {
+        snig::tsv_file_to_binary_file(
+          golden_path,
+          num_neurons,
+          layers_vec[i],
+          rows
+        );
+      }
+    }
+    else {
       snig::tsv_file_to_binary_file(
         golden_path,
         num_neurons,
-        layers_vec[i],
-        60000
+        num_layers,
+        rows
       );
     }
+  }).name("golden");
+
+  input.precede(golden);
+
+  executor.run(taskflow).wait();
+
+  std::cout << "weight files:\n";
+  report_parsing(weight_stats);
+  if(quantize) {
+    std::cout << "quantized weight files:\n";
+    report_parsing(quantized_stats);
   }
-  else {
-    snig::tsv_file_to_binary_file(
-      golden_path,
-      num_neurons,
-      num_layers,
-      60000
-    );
+  if(half) {
+    std::cout << "half weight files:\n";
+    report_parsing(half_stats);
   }
+  std::cout << "input files (" << rows << " inputs):\n";
+  report_parsing(input_stats);
+}
+
+void report_parsing(const snig::TSVStats& stats) {
+  std::cout << "  parsed " << stats.lines << " lines ("
+            << stats.bytes / (1024.0 * 1024.0) << " MB) in "
+            << stats.seconds << " s, "
+            << stats.mb_per_sec() << " MB/s\n";
 }
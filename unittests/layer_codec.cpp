@@ -0,0 +1,183 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+//the bundled doctest sizes its signal stack with SIGSTKSZ, which is not a constant in recent glibc
+#define DOCTEST_CONFIG_NO_POSIX_SIGNALS
+#include <doctest.h>
+
+#include <SNIG/utility/layer_codec.hpp>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+//packed CSC layer with section-relative rows, as written by the converter
+struct PackedLayer {
+  std::vector<int> col_w;
+  std::vector<uint16_t> short_row_w;
+  std::vector<float> val_w;
+};
+
+//column key of section s_o and input j is s_o * num_neurons + j
+//lengths[key] rows are drawn without repetition from the section of sec_size rows
+PackedLayer make_layer(
+  const std::vector<size_t>& lengths,
+  const size_t sec_size,
+  const bool uniform,
+  const bool sorted,
+  std::mt19937& gen
+) {
+  PackedLayer layer;
+  layer.col_w.push_back(0);
+  std::vector<uint16_t> rows(sec_size);
+  for(auto len : lengths) {
+    if(len == 0) {
+      layer.col_w.push_back(layer.short_row_w.size());
+      continue;
+    }
+    std::iota(rows.begin(), rows.end(), 0);
+    std::shuffle(rows.begin(), rows.end(), gen);
+    if(sorted) {
+      std::sort(rows.begin(), rows.begin() + len);
+    }
+    for(size_t k = 0; k < len; ++k) {
+      layer.short_row_w.push_back(rows[k]);
+      if(!uniform) {
+        layer.val_w.push_back(float(int(gen() % 33) - 16) / 16.f);
+      }
+    }
+    layer.col_w.push_back(layer.short_row_w.size());
+  }
+  if(uniform) {
+    layer.val_w.push_back(0.0625f);
+  }
+  return layer;
+}
+
+//decodes layer and compares col_w, the (row, value) pairs of each column, and the values
+void check_round_trip(const PackedLayer& layer, const size_t num_neurons, const size_t num_secs) {
+  const size_t num_keys = num_neurons * num_secs;
+  const size_t nnz = layer.short_row_w.size();
+  const bool uniform = layer.val_w.size() < nnz;
+
+  auto encoded = snig::encode_layer<float>(
+    layer.col_w.data(),
+    layer.short_row_w.data(),
+    layer.val_w.data(),
+    layer.val_w.size(),
+    num_neurons,
+    num_secs
+  );
+  REQUIRE(snig::encoded_nnz(encoded.data()) == nnz);
+  REQUIRE(snig::encoded_num_vals(encoded.data()) == layer.val_w.size());
+
+  std::vector<int> col_w(num_keys + 1, -1);
+  std::vector<uint16_t> short_row_w(nnz);
+  const float* val_w = snig::decode_layer<float>(encoded.data(), num_neurons, num_secs, col_w.data(), short_row_w.data());
+
+  REQUIRE(col_w == layer.col_w);
+  if(uniform) {
+    CHECK(val_w[0] == layer.val_w[0]);
+  }
+  //rows of a column come back sorted, values follow their rows
+  for(size_t key = 0; key < num_keys; ++key) {
+    std::vector<std::pair<uint16_t, float> > expected, decoded;
+    for(int k = col_w[key]; k < col_w[key + 1]; ++k) {
+      expected.emplace_back(layer.short_row_w[k], uniform ? 0.f : layer.val_w[k]);
+      decoded.emplace_back(short_row_w[k], uniform ? 0.f : val_w[k]);
+    }
+    std::sort(expected.begin(), expected.end());
+    REQUIRE(std::is_sorted(decoded.begin(), decoded.end()));
+    REQUIRE(decoded == expected);
+  }
+}
+
+TEST_CASE("unpack_bits") {
+  std::mt19937 gen(1);
+  for(uint32_t width = 1; width <= 17; ++width) {
+    for(size_t n = 1; n <= snig::CODEC_BLOCK; ++n) {
+      std::vector<uint32_t> values(n);
+      for(auto& v : values) {
+        v = gen() & ((uint32_t(1) << width) - 1);
+      }
+      //the widest value fixes the width of the block
+      values[gen() % n] = (uint32_t(1) << width) - 1;
+
+      std::vector<uint8_t> bytes;
+      snig::pack_block(values.data(), n, bytes);
+      REQUIRE(bytes[0] == width);
+      REQUIRE(bytes.size() == 1 + (n * width + 7) / 8);
+      //the decoder may read CODEC_PADDING bytes past the block
+      bytes.resize(bytes.size() + snig::CODEC_PADDING, 0xff);
+
+      std::vector<uint32_t> out(n);
+      snig::unpack_bits(bytes.data() + 1, n, width, out.data());
+      REQUIRE(out == values);
+#ifdef SNIG_ENABLE_X86_SIMD
+      if(__builtin_cpu_supports("avx2")) {
+        std::fill(out.begin(), out.end(), 0);
+        snig::unpack_bits_avx2(bytes.data() + 1, n, width, out.data());
+        REQUIRE(out == values);
+      }
+#endif
+      std::fill(out.begin(), out.end(), 0);
+      REQUIRE(snig::unpack_block(bytes.data(), n, out.data()) == bytes.data() + 1 + (n * width + 7) / 8);
+      REQUIRE(out == values);
+    }
+  }
+
+  //a block of zeros is its width byte only
+  std::vector<uint32_t> zeros(snig::CODEC_BLOCK, 0), out(snig::CODEC_BLOCK, 1);
+  std::vector<uint8_t> bytes;
+  snig::pack_block(zeros.data(), zeros.size(), bytes);
+  REQUIRE(bytes.size() == 1);
+  CHECK(snig::unpack_block(bytes.data(), out.size(), out.data()) == bytes.data() + 1);
+  CHECK(out == zeros);
+}
+
+TEST_CASE("encode_decode_layer") {
+  std::mt19937 gen(2);
+  const size_t num_secs = 4;
+  for(size_t sec_size : {1, 7, 64, 300, 1024}) {
+    const size_t num_neurons = sec_size * num_secs;
+    for(bool uniform : {false, true}) {
+      for(bool sorted : {false, true}) {
+        //every length from 0 to the full section, then random lengths
+        //with runs of empty columns, so blocks of counts and gaps take many widths
+        std::vector<size_t> lengths(num_neurons * num_secs);
+        for(size_t key = 0; key < lengths.size(); ++key) {
+          if(key <= sec_size) {
+            lengths[key] = key;
+          }
+          else {
+            lengths[key] = (gen() % 4 == 0) ? 0 : gen() % (std::min<size_t>(sec_size, 40) + 1);
+          }
+        }
+        std::shuffle(lengths.begin(), lengths.end(), gen);
+        check_round_trip(make_layer(lengths, sec_size, uniform, sorted, gen), num_neurons, num_secs);
+      }
+    }
+  }
+}
+
+TEST_CASE("encode_decode_empty_layer") {
+  std::mt19937 gen(3);
+  std::vector<size_t> lengths(16 * 2, 0);
+  check_round_trip(make_layer(lengths, 8, false, true, gen), 16, 2);
+}
+
+TEST_CASE("encode_decode_widest_layer") {
+  //a full column of 65536 rows needs 17 bits per count
+  //a column of rows 0 and 65535 needs 16 bits per gap
+  std::mt19937 gen(4);
+  const size_t sec_size = 65536;
+  std::vector<size_t> lengths(sec_size, 0);
+  lengths[0] = sec_size;
+  lengths[1] = 1;
+  PackedLayer layer = make_layer(lengths, sec_size, false, true, gen);
+  layer.short_row_w[sec_size] = 0;
+  layer.short_row_w.push_back(sec_size - 1);
+  layer.val_w.push_back(1.f);
+  for(size_t key = 2; key < layer.col_w.size(); ++key) {
+    layer.col_w[key] += 1;
+  }
+  check_round_trip(layer, sec_size, 1);
+}